@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""
+Minimal FastCGI responder for trying out fastcgi_pass locally. It runs the script named by
+SCRIPT_FILENAME like a CGI script, with the request's params as its environment, and sends its
+output back while it runs. Requests on one connection are multiplexed and connections are kept
+open, so the server's connection reuse can be watched in the log.
+
+    python3 responder.py unix:/tmp/webserv-fcgi.sock
+    python3 responder.py 127.0.0.1:9000
+"""
+
+import os
+import socket
+import struct
+import subprocess
+import sys
+import threading
+
+BEGIN_REQUEST, ABORT_REQUEST, END_REQUEST, PARAMS, STDIN, STDOUT = 1, 2, 3, 4, 5, 6
+GET_VALUES, GET_VALUES_RESULT = 9, 10
+KEEP_CONN = 1
+
+
+def read_length(data, pos):
+    if data[pos] & 0x80:
+        return struct.unpack(">I", data[pos:pos + 4])[0] & 0x7FFFFFFF, pos + 4
+    return data[pos], pos + 1
+
+
+def read_pairs(data):
+    pairs, pos = {}, 0
+    while pos < len(data):
+        name_length, pos = read_length(data, pos)
+        value_length, pos = read_length(data, pos)
+        name = data[pos:pos + name_length].decode("latin-1")
+        pos += name_length
+        pairs[name] = data[pos:pos + value_length].decode("latin-1")
+        pos += value_length
+    return pairs
+
+
+def encode_length(length):
+    return bytes([length]) if length < 0x80 else struct.pack(">I", length | 0x80000000)
+
+
+class Connection:
+    def __init__(self, sock):
+        self.sock = sock
+        self.lock = threading.Lock()
+        self.requests = {}
+
+    def send(self, kind, request_id, content=b""):
+        with self.lock:
+            for start in range(0, max(len(content), 1), 65535):
+                part = content[start:start + 65535]
+                self.sock.sendall(struct.pack(">BBHHBx", 1, kind, request_id, len(part), 0) + part)
+
+    def end(self, request_id, status):
+        self.send(STDOUT, request_id)
+        self.send(END_REQUEST, request_id, struct.pack(">IB3x", status & 0xFFFFFFFF, 0))
+
+    def run(self):
+        buffer = b""
+        keep_conn = True
+        while True:
+            data = self.sock.recv(65536)
+            if not data:
+                break
+            buffer += data
+            while len(buffer) >= 8:
+                _, kind, request_id, length, padding = struct.unpack(">BBHHB", buffer[:7])
+                if len(buffer) < 8 + length + padding:
+                    break
+                content, buffer = buffer[8:8 + length], buffer[8 + length + padding:]
+                keep_conn = self.handle(kind, request_id, content) and keep_conn
+            if not keep_conn and not self.requests:
+                break
+        for request in list(self.requests.values()):
+            if request.get("process"):
+                request["process"].kill()
+        self.sock.close()
+
+    def handle(self, kind, request_id, content):
+        request = self.requests.get(request_id)
+        if kind == GET_VALUES:
+            reply = b""
+            for name in read_pairs(content):
+                value = {"FCGI_MPXS_CONNS": "1", "FCGI_MAX_REQS": "100"}.get(name)
+                if value is not None:
+                    reply += encode_length(len(name)) + encode_length(len(value))
+                    reply += name.encode() + value.encode()
+            self.send(GET_VALUES_RESULT, 0, reply)
+        elif kind == BEGIN_REQUEST:
+            self.requests[request_id] = {"params": b""}
+            return bool(content[2] & KEEP_CONN)
+        elif request is None:
+            pass
+        elif kind == PARAMS and content:
+            request["params"] += content
+        elif kind == PARAMS:
+            self.start(request_id, request)
+        elif kind == STDIN and content:
+            try:
+                request["process"].stdin.write(content)
+                request["process"].stdin.flush()
+            except (BrokenPipeError, ValueError):
+                pass
+        elif kind == STDIN:
+            request["process"].stdin.close()
+        elif kind == ABORT_REQUEST:
+            request["process"].kill()
+        return True
+
+    def start(self, request_id, request):
+        env = read_pairs(request["params"])
+        script = env.get("SCRIPT_FILENAME", "")
+        sys.stderr.write("request %d on fd %d: %s %s\n" % (request_id, self.sock.fileno(),
+                         env.get("REQUEST_METHOD"), script))
+        request["process"] = subprocess.Popen([script], cwd=os.path.dirname(script), env=env,
+                                              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+        threading.Thread(target=self.relay, args=(request_id, request), daemon=True).start()
+
+    def relay(self, request_id, request):
+        process = request["process"]
+        try:
+            while True:
+                chunk = process.stdout.read1(16384)
+                if not chunk:
+                    break
+                self.send(STDOUT, request_id, chunk)
+            self.end(request_id, process.wait())
+        except OSError:
+            pass
+        self.requests.pop(request_id, None)
+
+
+def main():
+    address = sys.argv[1] if len(sys.argv) > 1 else "unix:/tmp/webserv-fcgi.sock"
+    if address.startswith("unix:"):
+        path = address[5:]
+        if os.path.exists(path):
+            os.unlink(path)
+        server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        server.bind(path)
+    else:
+        host, port = address.rsplit(":", 1)
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind((host, int(port)))
+    server.listen(64)
+    sys.stderr.write("FastCGI responder listening on %s\n" % address)
+    while True:
+        sock, _ = server.accept()
+        sys.stderr.write("new connection, fd %d\n" % sock.fileno())
+        threading.Thread(target=Connection(sock).run, daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+Worker for `cgi_pool`. The server starts it with a socket as its stdin and stdout and sends it
+FastCGI records, one request at a time. Each request runs the Python script named by
+SCRIPT_FILENAME inside this interpreter, so starting Python and importing the common modules is
+paid once per worker instead of once per request.
+
+    cgi_pool ./assets/cgi-examples/fastcgi/worker.py workers=4 requests=1000;
+"""
+
+import io
+import os
+import runpy
+import struct
+import sys
+import traceback
+
+# imported once here so the scripts find them already loaded
+import hashlib  # noqa: F401
+import json  # noqa: F401
+import time  # noqa: F401
+import urllib.parse  # noqa: F401
+
+BEGIN_REQUEST, ABORT_REQUEST, END_REQUEST, PARAMS, STDIN, STDOUT = 1, 2, 3, 4, 5, 6
+GET_VALUES, GET_VALUES_RESULT = 9, 10
+
+IN_FD, OUT_FD = 0, 1
+
+
+def write_all(data):
+    while data:
+        data = data[os.write(OUT_FD, data):]
+
+
+def send(kind, request_id, content=b""):
+    for start in range(0, max(len(content), 1), 65535):
+        part = content[start:start + 65535]
+        write_all(struct.pack(">BBHHBx", 1, kind, request_id, len(part), 0) + part)
+
+
+def encode_length(length):
+    return bytes([length]) if length < 0x80 else struct.pack(">I", length | 0x80000000)
+
+
+def read_pairs(data):
+    pairs, pos = {}, 0
+    while pos < len(data):
+        lengths = []
+        for _ in range(2):
+            if data[pos] & 0x80:
+                lengths.append(struct.unpack(">I", data[pos:pos + 4])[0] & 0x7FFFFFFF)
+                pos += 4
+            else:
+                lengths.append(data[pos])
+                pos += 1
+        name = data[pos:pos + lengths[0]].decode("latin-1")
+        pos += lengths[0]
+        pairs[name] = data[pos:pos + lengths[1]].decode("latin-1")
+        pos += lengths[1]
+    return pairs
+
+
+class Records:
+    """Reads records from the server and keeps those of requests that are not running yet."""
+
+    def __init__(self):
+        self.buffer = b""
+        self.waiting = []
+
+    def next(self):
+        if self.waiting:
+            return self.waiting.pop(0)
+        while True:
+            if len(self.buffer) >= 8:
+                _, kind, request_id, length, padding = struct.unpack(">BBHHB", self.buffer[:7])
+                if len(self.buffer) >= 8 + length + padding:
+                    content = self.buffer[8:8 + length]
+                    self.buffer = self.buffer[8 + length + padding:]
+                    return kind, request_id, content
+            data = os.read(IN_FD, 65536)
+            if not data:
+                sys.exit(0)   # the server closed the pool or retired this worker
+            self.buffer += data
+
+    def next_for(self, request_id, kinds):
+        """Returns the next record of the request with one of the kinds, keeping the others."""
+        skipped = []
+        while True:
+            record = self.next()
+            if record[1] == request_id and record[0] in kinds:
+                self.waiting = skipped + self.waiting
+                return record
+            if record[0] == GET_VALUES:
+                answer_values(record[2])
+            else:
+                skipped.append(record)
+
+
+class RequestBody(io.RawIOBase):
+    """The script's stdin, read from the request's FCGI_STDIN records as they arrive."""
+
+    def __init__(self, records, request_id):
+        self.records = records
+        self.request_id = request_id
+        self.pending = b""
+        self.done = False
+
+    def readable(self):
+        return True
+
+    def readinto(self, buffer):
+        while not self.pending and not self.done:
+            kind, _, content = self.records.next_for(self.request_id, (STDIN, ABORT_REQUEST))
+            self.done = kind == ABORT_REQUEST or not content
+            self.pending = content
+        size = min(len(buffer), len(self.pending))
+        buffer[:size] = self.pending[:size]
+        self.pending = self.pending[size:]
+        return size
+
+    def finish(self):
+        while not self.done:
+            self.readinto(bytearray(65536))
+
+
+class Output(io.RawIOBase):
+    """The script's stdout, sent as FCGI_STDOUT records."""
+
+    def __init__(self, request_id):
+        self.request_id = request_id
+
+    def writable(self):
+        return True
+
+    def write(self, data):
+        send(STDOUT, self.request_id, bytes(data))
+        return len(data)
+
+
+def answer_values(content):
+    values = {"FCGI_MPXS_CONNS": "0", "FCGI_MAX_CONNS": "1", "FCGI_MAX_REQS": "1"}
+    reply = b""
+    for name in read_pairs(content):
+        if name in values:
+            reply += encode_length(len(name)) + encode_length(len(values[name]))
+            reply += name.encode() + values[name].encode()
+    send(GET_VALUES_RESULT, 0, reply)
+
+
+def run(records, request_id):
+    params = b""
+    while True:
+        kind, _, content = records.next_for(request_id, (PARAMS, ABORT_REQUEST))
+        if kind == ABORT_REQUEST:
+            send(END_REQUEST, request_id, struct.pack(">IB3x", 0, 0))
+            return
+        if not content:
+            break
+        params += content
+    env = read_pairs(params)
+    script = env.get("SCRIPT_FILENAME", "")
+    body = RequestBody(records, request_id)
+    stdout = io.BufferedWriter(Output(request_id), 16384)
+    saved = sys.stdin, sys.stdout, sys.argv, os.getcwd(), dict(os.environ)
+    status = 0
+    sys.stdin = io.TextIOWrapper(io.BufferedReader(body), encoding="latin-1")
+    sys.stdout = io.TextIOWrapper(stdout, encoding="utf-8", write_through=True)
+    sys.argv = [script]
+    os.environ.clear()
+    os.environ.update(env)
+    try:
+        os.chdir(os.path.dirname(script))
+        runpy.run_path(script, run_name="__main__")
+    except SystemExit as exit_:
+        status = exit_.code if isinstance(exit_.code, int) else 1
+    except Exception:
+        traceback.print_exc()
+        status = 1
+    finally:
+        try:
+            sys.stdout.flush()
+        except OSError:
+            pass
+        sys.stdin, sys.stdout, sys.argv = saved[0], saved[1], saved[2]
+        os.chdir(saved[3])
+        os.environ.clear()
+        os.environ.update(saved[4])
+    body.finish()
+    send(STDOUT, request_id)
+    send(END_REQUEST, request_id, struct.pack(">IB3x", status & 0xFFFFFFFF, 0))
+
+
+def main():
+    records = Records()
+    while True:
+        kind, request_id, content = records.next()
+        if kind == GET_VALUES:
+            answer_values(content)
+        elif kind == BEGIN_REQUEST:
+            run(records, request_id)
+
+
+if __name__ == "__main__":
+    main()
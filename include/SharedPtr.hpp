@@ -0,0 +1,112 @@
+/**
+ * @file SharedPtr.hpp
+ * @author agent (agent@local)
+ * @brief Reference counted pointer for objects shared between caches and in-flight responses
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef SHARED_PTR_HPP
+#define SHARED_PTR_HPP
+
+#include <cstddef>
+
+/**
+ * @brief Minimal C++98 replacement for std::shared_ptr. The object is deleted when the last
+ * SharedPtr pointing to it is destroyed. Not thread safe.
+ *
+ * @tparam T Type of the shared object
+ */
+template <typename T> class SharedPtr
+{
+  private:
+    struct Block
+    {
+        T *ptr;
+        size_t refs;
+    };
+    Block *_block;
+
+    void release()
+    {
+        Block *block = _block;
+
+        _block = NULL;
+        if (block != NULL && --block->refs == 0)
+        {
+            delete block->ptr;
+            delete block;
+        }
+    }
+
+  public:
+    SharedPtr() : _block(NULL)
+    {
+    }
+
+    explicit SharedPtr(T *ptr) : _block(NULL)
+    {
+        if (ptr == NULL)
+            return;
+        _block = new Block;
+        _block->ptr = ptr;
+        _block->refs = 1;
+    }
+
+    SharedPtr(const SharedPtr &other) : _block(other._block)
+    {
+        if (_block != NULL)
+            _block->refs++;
+    }
+
+    SharedPtr &operator=(const SharedPtr &other)
+    {
+        if (_block != other._block)
+        {
+            release();
+            _block = other._block;
+            if (_block != NULL)
+                _block->refs++;
+        }
+        return *this;
+    }
+
+    ~SharedPtr()
+    {
+        release();
+    }
+
+    T *get() const
+    {
+        return _block != NULL ? _block->ptr : NULL;
+    }
+
+    T &operator*() const
+    {
+        return *_block->ptr;
+    }
+
+    T *operator->() const
+    {
+        return _block->ptr;
+    }
+
+    bool isNull() const
+    {
+        return _block == NULL;
+    }
+
+    size_t useCount() const
+    {
+        return _block != NULL ? _block->refs : 0;
+    }
+
+    void reset()
+    {
+        release();
+    }
+};
+
+#endif
@@ -12,21 +12,62 @@
 #define CGI_UTILS_HPP
 
 #define GATEWAY_TIMEOUT 10
-#define CGI_OUTFILE     "cgiOutFile"
+#define CGI_ENV_RESERVE 4096   // bytes reserved for an environment, enough for most requests
+#define CGI_LIMITS_ENV "WEBSERV_CGI_LIMITS"   // set when the server is a script's limits wrapper
 #include "logger/Logger.hpp"
+#include <map>
 #include <requests/Resource.hpp>
+#include <string>
 #include <sys/wait.h>
+#include <vector>
 
 typedef std::map<std::string, std::string> headMap;
 using logger::Log;
 
-void addToEnv(std::vector<char *> &env, std::string var);
+/**
+ * @brief The header block of a script's output, read as RFC 3875 section 6 describes it
+ */
+struct CGIHeaders
+{
+    std::string status;   // code and reason phrase of the response
+    int statusCode;
+    std::string contentType;
+    std::string location;
+    bool hasLength;
+    size_t contentLength;
+    bool encoded;         // the script set its own Content-Encoding
+    std::string fields;   // header lines passed on to the client, CRLF included
+};
+
+/**
+ * @brief The environment of a CGI request, kept as "NAME=value" strings one after another in a
+ * single buffer. The variables that are the same for every request on a port are built once
+ * and copied in as one block
+ */
+class CGIEnvironment
+{
+  private:
+    std::string _block;   // every variable followed by a '\0'
+
+    static std::map<unsigned int, std::string> staticBlocks;
+
+  public:
+    CGIEnvironment(unsigned int port);
+    void add(const char *name, const std::string &value);
+    void addHeader(const std::string &header, const std::string &value);
+    const std::string &block() const;
+    std::vector<char *> envp() const;
+};
+
 std::string getCGIVirtualPath(const Resource &res);
-void addHeadersToEnv(std::vector<char *> &env, headMap map);
-void addPathEnv(std::vector<char *> &env, const Resource &res);
-pid_t waitCGI(pid_t pid, int &status, int &sendErrCode);
-int checkCGIError(pid_t pid, int sendErrCode, int waitStatus, int status);
+void addHeadersToEnv(CGIEnvironment &env, const headMap &map);
+void addPathEnv(CGIEnvironment &env, const Resource &res);
 std::vector<char *> createExecArgs(std::string path);
-pid_t startCGIProcess(std::vector<char *> env, int p[2], int &outFd);
+pid_t startCGIProcess(const std::string &path, const CGIEnvironment &env, const CGILimits &limits,
+                      int in[2], int out[2]);
+int execWithCGILimits(char **argv);
+bool parseCGIStatus(const std::string &value, CGIHeaders &h);
+bool parseCGIHeaders(const std::string &block, CGIHeaders &h);
+bool findCGIHeaderEnd(const std::string &output, size_t &headerEnd, size_t &bodyStart);
 
 #endif
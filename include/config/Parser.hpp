@@ -84,6 +84,21 @@ class Parser
     void parseAutoIndex();
     void parseIndex();
     void parseCGI();
+    void parseOpenFileCache();
+    void checkOpenFileCache() const;
+    void parseCompressTypes();
+    void parseCompressLevel();
+    void parseCompressMinLength();
+    std::vector<std::string> parseCacheExtensions();
+    void parseExpires();
+    void parseCacheControl();
+    void parseFastCGIPass();
+    void parseCGIPool();
+    void parseCGICache();
+    void parseCGIMaxConcurrency();
+    void parseCGIQueue();
+    void parseCGILimits();
+    void resolveCachePolicies();
 
     // Methods to reset parsed attributes
     void resetServerBlockAttributes();
@@ -17,11 +17,53 @@
 #include <string>
 #include <vector>
 
+#define DEFAULT_OPEN_FILE_CACHE_VALID 60
+#define DEFAULT_COMPRESS_LEVEL        6
+#define DEFAULT_CGI_POOL_WORKERS      4
+#define DEFAULT_CGI_POOL_REQUESTS     1000
+#define DEFAULT_CGI_CACHE_STALE       60
+#define DEFAULT_CGI_CACHE_KEY         "$host$request_uri"
+#define DEFAULT_CGI_QUEUE             64
+#define DEFAULT_COMPRESS_MIN_LENGTH   1024
+#define MAX_COMPRESS_LEVEL            9
+#define EXPIRES_UNSET                 -1   // inherited from the policy for all files
+#define EXPIRES_OFF                   -2   // no Expires header and no max-age
+
+/**
+ * @brief Caching headers sent with static files. The Cache-Control line is formatted when the
+ * config is parsed, so only the Expires date is formatted per response
+ */
+struct CachePolicy
+{
+    long expires;               // Seconds until the file expires, or EXPIRES_UNSET / EXPIRES_OFF
+    std::string cacheControl;   // Value of the `cache_control` rule
+    std::string header;         // Complete Cache-Control line, empty if none is sent
+
+    CachePolicy();
+};
+
+/**
+ * @brief Resource limits of the CGI scripts started for a location, 0 or empty for no limit
+ */
+struct CGILimits
+{
+    size_t cpu;             // Seconds of CPU time (RLIMIT_CPU)
+    size_t addressSpace;    // Bytes of virtual memory (RLIMIT_AS)
+    size_t openFiles;       // RLIMIT_NOFILE
+    size_t processes;       // RLIMIT_NPROC, counted for the server's whole user
+    std::string cgroup;     // cgroup v2 directory the scripts are moved to
+    unsigned int cgroupCPU; // cpu.max of the cgroup, in percent of one CPU
+    size_t cgroupMemory;    // memory.max of the cgroup, in bytes
+
+    CGILimits();
+};
+
 /**
  * @brief This struct holds the configuration of a single route
  */
 struct Route
 {
+    std::string location;                  // Path of the location block
     std::string serveDir;                  // Required
     size_t bodySize;                       // Optional
     bool autoIndex;                        // Optional, false by default
@@ -29,6 +71,23 @@ struct Route
     std::string indexFile;                 // Optional
     std::string redirectTo;                // Required if serveDir is not provided
     std::set<HTTPMethod> methodsAllowed;   // Methods allowed on this route
+    size_t openFileCacheMax;               // Optional, 0 (disabled) by default
+    unsigned int openFileCacheValid;       // Seconds before a cached file is checked again
+    std::set<std::string> compressTypes;   // Optional, responses of these types are gzipped
+    int compressLevel;                     // gzip level [1 - 9]
+    size_t compressMinLength;              // Smaller responses are sent uncompressed
+    std::map<std::string, CachePolicy> cachePolicies;   // Optional, by file extension, with
+                                                        // "" for all other files
+    std::string fastcgiPass;   // Optional, FastCGI app that runs the CGI files instead of a fork
+    std::string cgiPool;       // Optional, worker program kept running to handle the CGI files
+    size_t cgiPoolWorkers;     // Workers started for the pool
+    size_t cgiPoolRequests;    // Requests a worker handles before it is replaced, 0 for no limit
+    unsigned int cgiCacheTTL;     // Optional, seconds a CGI response is reused, 0 (off) by default
+    unsigned int cgiCacheStale;   // Seconds a stale response is served while it is regenerated
+    std::string cgiCacheKey;      // Variables identifying a cached response
+    size_t cgiMaxConcurrency;     // Optional, CGI requests running at once, 0 (no limit) by default
+    size_t cgiQueue;              // Requests waiting for one of them before 503s are sent
+    CGILimits cgiLimits;          // Optional, none by default
 };
 
 /**
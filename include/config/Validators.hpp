@@ -21,5 +21,12 @@ bool validateDirectory(const std::string &dirPath);
 bool validatePort(const std::string &portStr);
 bool validateURL(const std::string &urlStr);
 bool validateBodySize(const std::string &bodySizeStr);
+bool validatePositiveNumber(const std::string &numStr);
+bool validateDuration(const std::string &durationStr);
+bool validateSize(const std::string &sizeStr);
+bool validateMimeType(const std::string &mimeType);
+bool validateUpstream(const std::string &address);
+bool validateExecutable(const std::string &path);
+bool validateCacheKey(const std::string &key);
 
 #endif
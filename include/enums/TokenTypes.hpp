@@ -35,6 +35,18 @@ typedef enum
     INDEX,
     CGI_EXTENSION,
     RETURN,
+    OPEN_FILE_CACHE,
+    COMPRESS_TYPES,
+    COMPRESS_LEVEL,
+    COMPRESS_MIN_LENGTH,
+    EXPIRES,
+    CACHE_CONTROL,
+    FASTCGI_PASS,
+    CGI_POOL,
+    CGI_CACHE,
+    CGI_MAX_CONCURRENCY,
+    CGI_QUEUE,
+    CGI_LIMITS,
 
     // Literals.
     WORD
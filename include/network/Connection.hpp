@@ -56,8 +56,11 @@ class Connection
     std::string ip();
     void processRequest();
     bool keepConnectionAlive();
+    short pollEvents();
+    bool streamToCGI();
+    bool idle();
     bool bodySizeExceeded();
-    std::vector<char *> prepCGIEnvironment();
+    CGIEnvironment prepCGIEnvironment();
     ~Connection();
 };
 
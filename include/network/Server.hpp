@@ -23,6 +23,7 @@
 #define MAX_CLIENTS     170
 #define READ_SIZE       1000000
 #define START_POS(x, y) (x <= y ? 0 : x - y)
+#define POLL_TIMEOUT    1000   // ms, timeouts are checked at least this often
 
 typedef std::vector<ServerBlock> &serverList;
 
@@ -41,6 +42,9 @@ class Server
     void recvData(size_t clientNo);
     void readBody(size_t clientNo);
     void respondToRequest(size_t clientNo);
+    void preparePoll(std::vector<pollfd> &fds);
+    void updateCGIs(time_t now);
+    void closeIdleConnections(time_t now);
 
   public:
     Server(serverList virtualServers);
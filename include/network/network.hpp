@@ -34,6 +34,11 @@
 #include <unistd.h>
 #include <vector>
 
+// a client shutting down its side of the connection is only reported on its own on Linux
+#ifndef POLLRDHUP
+#define POLLRDHUP 0
+#endif
+
 #define PORT "1234"
 #define HW_HTML                                                                                    \
     "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=UTF-8\r\nContent-Length: "                \
@@ -53,6 +53,7 @@ class Request
     bool keepAlive() const;
     unsigned int keepAliveTimer() const;
     const std::string hostname() const;
+    const std::string query() const;
     int listener() const;
 
     // Returns a resource object associated with the request
@@ -51,6 +51,7 @@ class RequestParser
     size_t maxBodySize() const;
     const Resource &resource() const;
     const std::string hostname() const;
+    const std::string query() const;
 
     // Clears the parser attributes
     void clear();
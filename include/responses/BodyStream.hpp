@@ -0,0 +1,41 @@
+/**
+ * @file BodyStream.hpp
+ * @author agent (agent@local)
+ * @brief Interface for response bodies that are produced while the response is being sent
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef BODY_STREAM_HPP
+#define BODY_STREAM_HPP
+
+#include "SharedPtr.hpp"
+#include <string>
+
+// results of BodyStream::read()
+#define STREAM_DATA  0   // bytes were appended, more may follow
+#define STREAM_AGAIN 1   // nothing to send yet, try again later
+#define STREAM_END   2   // the body is complete, the last bytes (if any) were appended
+#define STREAM_ERROR 3   // the body cannot be completed
+
+/**
+ * @brief A body of unknown length, sent with chunked encoding. The response asks for the next
+ * piece only once everything before it was sent, so a slow client slows down the producer
+ * instead of making the response buffer grow
+ */
+class BodyStream
+{
+  public:
+    virtual ~BodyStream()
+    {
+    }
+
+    // Appends the next piece of the body to out, returns one of the STREAM_ results
+    virtual int read(std::string &out) = 0;
+};
+
+typedef SharedPtr<BodyStream> StreamHandle;
+
+#endif
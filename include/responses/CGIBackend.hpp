@@ -0,0 +1,86 @@
+/**
+ * @file CGIBackend.hpp
+ * @author agent (agent@local)
+ * @brief Interface of whatever runs a CGI request: a forked script or a FastCGI app
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef CGI_BACKEND_HPP
+#define CGI_BACKEND_HPP
+
+#include "SharedPtr.hpp"
+#include "requests/Request.hpp"
+#include "responses/Compression.hpp"
+#include <ctime>
+#include <poll.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#define CGI_READ_SIZE  16384    // bytes read from the script's output at a time
+#define CGI_HEADER_MAX 65536    // longest header block accepted from a script
+#define CGI_INPUT_MAX  262144   // body bytes buffered for a script before the client is paused
+
+class CGIEnvironment;
+
+/**
+ * @brief A CGI request in progress. The response feeds it the request body and reads its output
+ * (a CGI header block followed by the body) without ever blocking. The state of relaying the
+ * output is kept here as well, so the response does not depend on where the output comes from
+ */
+class CGIBackend
+{
+  private:
+    CGIBackend(const CGIBackend &backend);
+    CGIBackend &operator=(const CGIBackend &backend);
+
+  protected:
+    size_t _bodyLeft;   // body bytes the client has yet to send
+    time_t _lastActivity;
+
+  public:
+    const Resource resource;
+    const bool keepAlive;
+    const bool headOnly;   // only the headers of the output are sent
+    std::string header;    // output read while looking for the end of the header block
+    bool streaming;        // the header block is sent and the body is being relayed
+    bool chunked;          // the body is relayed with chunked encoding
+    size_t outputLeft;     // body bytes still to relay when the response has a Content-Length
+    bool clientAcceptsGzip;
+    SharedPtr<GzipStream> gzip;   // compresses the body as it is relayed, null if not compressed
+    bool failed;           // the request was stopped after its headers were sent
+
+    static size_t cancelled;   // requests stopped because their client left
+
+    CGIBackend(Request &request);
+    virtual ~CGIBackend();
+
+    // Adds the descriptors the event loop should wait on
+    virtual void addPollFds(std::vector<pollfd> &fds, bool wantOutput) const = 0;
+    // Passes body bytes received from the client, returns how many belong to the body
+    virtual size_t feed(const char *data, size_t len) = 0;
+    // Whether reading from the client should pause until the backend catches up
+    virtual bool inputFull() const = 0;
+    // Sends as much of the received body as possible
+    virtual void writeInput() = 0;
+    // Reads output, returns 0 at its end and -1 if nothing is available yet
+    virtual ssize_t readOutput(char *buf, size_t size) = 0;
+    // Output bytes that can be spliced from outputPipe() without reading them first
+    virtual size_t available() const;
+    virtual int outputPipe() const;
+    // Stops the request, its output is not needed anymore
+    virtual void terminate() = 0;
+
+    virtual void touch();
+    virtual bool timedOut(time_t now) const;
+
+    static SharedPtr<CGIBackend> start(Request &request, const CGIEnvironment &env);
+    static SharedPtr<CGIBackend> launch(Request &request, const CGIEnvironment &env);
+};
+
+typedef SharedPtr<CGIBackend> CGIHandle;
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file CGICache.hpp
+ * @author agent (agent@local)
+ * @brief In-memory cache of CGI responses for locations with cgi_cache
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef CGI_CACHE_HPP
+#define CGI_CACHE_HPP
+
+#include "SharedPtr.hpp"
+#include "cgiUtils.hpp"
+#include "responses/CGIBackend.hpp"
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#define CGI_CACHE_MAX_BYTES 16777216   // 16MB for all cached CGI responses
+#define CGI_CACHE_MAX_ENTRY 1048576    // longer outputs stop the script and fail its readers
+
+/**
+ * @brief One run of a script whose output is kept for the cache. Every client asking for the
+ * same key while it runs reads the output as it arrives, so only one run happens per key
+ */
+struct CGICacheJob
+{
+    CGIHandle backend;    // null once the output is complete
+    std::string output;   // everything the script wrote, headers included
+    bool done;
+    bool failed;          // the output is incomplete
+    time_t ttl;
+    time_t stale;
+};
+
+typedef SharedPtr<CGICacheJob> CGIJobHandle;
+
+/**
+ * @brief Replays the output of a job to one response, as if it came from the script itself.
+ * Stopping it leaves the job running for the other clients and the cache
+ */
+class CGICacheReader : public CGIBackend
+{
+  private:
+    CGIJobHandle _job;
+    size_t _offset;   // bytes of the job's output already read
+
+    CGICacheReader(const CGICacheReader &reader);
+    CGICacheReader &operator=(const CGICacheReader &reader);
+
+  public:
+    CGICacheReader(const CGIJobHandle &job, Request &request);
+
+    void addPollFds(std::vector<pollfd> &fds, bool wantOutput) const;
+    size_t feed(const char *data, size_t len);
+    bool inputFull() const;
+    void writeInput();
+    ssize_t readOutput(char *buf, size_t size);
+    void terminate();
+};
+
+/**
+ * @brief Keeps the complete output of CGI GET requests for the ttl of their location, so
+ * repeated requests are answered from memory without running the script. A stale entry is
+ * still served for the location's stale time while a single job regenerates it in the
+ * background. The jobs are polled by the server's event loop like the responses' scripts
+ */
+class CGICache
+{
+  private:
+    struct Entry
+    {
+        CGIJobHandle response;
+        time_t expires;        // served without regenerating until then
+        time_t staleExpires;   // served while regenerating until then
+    };
+
+    std::map<std::string, Entry> _entries;
+    std::map<std::string, CGIJobHandle> _jobs;   // regenerations in progress, by key
+    size_t _bytes;
+    time_t _lastSweep;
+
+    static CGICache cache;
+
+    CGICache();
+    CGIJobHandle startJob(const std::string &key, Request &request, const CGIEnvironment &env);
+    void store(const std::string &key, CGICacheJob &job, time_t now);
+    void erase(std::map<std::string, Entry>::iterator entry);
+    void sweep(time_t now);
+
+  public:
+    size_t hits;
+    size_t staleHits;
+    size_t misses;
+    size_t coalesced;   // misses that joined a job started by another request
+
+    static CGICache &getCache();
+    static std::string key(const std::string &format, Request &request);
+
+    CGIHandle open(Request &request, const CGIEnvironment &env);
+    void addPollFds(std::vector<pollfd> &fds) const;
+    void update(time_t now);
+    void purge();
+    void logStats() const;
+};
+
+bool prepareCGICacheEntry(std::string &output);
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file CGIProcess.hpp
+ * @author agent (agent@local)
+ * @brief A running CGI script driven by the server's event loop
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef CGI_PROCESS_HPP
+#define CGI_PROCESS_HPP
+
+#include "responses/CGIBackend.hpp"
+#include <ctime>
+#include <map>
+
+#define CGI_STOP_GRACE 3   // seconds a stopped script has to exit before it is killed
+
+/**
+ * @brief Tracks one CGI script from fork() until its output has been relayed. The request body
+ * is written to the script's stdin as it arrives from the client and its stdout is read whenever
+ * the pipes are ready, and the script's exit is noticed when the server reaps it after a
+ * SIGCHLD, so no step ever blocks the event loop. Each script leads its own process group, so
+ * stopping it stops whatever it started as well
+ */
+class CGIProcess : public CGIBackend
+{
+  private:
+    pid_t _pid;
+    int _input;          // write end of the script's stdin, -1 once the whole body is written
+    int _output;         // read end of the script's stdout
+    std::string _body;   // received body bytes for the script's stdin
+    size_t _written;     // bytes of _body already written
+    bool _exited;
+
+    static std::map<pid_t, CGIProcess *> running;
+    static std::map<pid_t, time_t> stopping;   // stopped scripts not reaped yet, by kill time
+    static size_t stopped;
+    static size_t killed;   // stopped scripts that ignored SIGTERM
+
+    CGIProcess(const CGIProcess &process);
+    CGIProcess &operator=(const CGIProcess &process);
+    void closeInput();
+
+  public:
+    CGIProcess(pid_t pid, int input, int output, Request &request);
+    ~CGIProcess();
+
+    void addPollFds(std::vector<pollfd> &fds, bool wantOutput) const;
+    size_t feed(const char *data, size_t len);
+    bool inputFull() const;
+    void writeInput();
+    ssize_t readOutput(char *buf, size_t size);
+    size_t available() const;
+    int outputPipe() const;
+    void terminate();
+
+    static void reapChildren();
+    static void killStopped(time_t now);
+    static void stopAll();
+    static void logStats();
+};
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * @file CGIQueue.hpp
+ * @author agent (agent@local)
+ * @brief Limits the CGI requests a location runs at once, with a queue for the others
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef CGI_QUEUE_HPP
+#define CGI_QUEUE_HPP
+
+#include "cgiUtils.hpp"
+#include "responses/CGIBackend.hpp"
+#include <deque>
+#include <map>
+#include <string>
+
+#define CGI_RETRY_AFTER 1   // seconds a client turned away by a full queue is told to wait
+
+/**
+ * @brief A CGI request on a location with cgi_max_concurrency. It holds one of the location's
+ * slots while its script runs, or waits in the queue with a copy of the request until a slot is
+ * free. Everything else is passed to the backend it started
+ */
+class QueuedCGI : public CGIBackend
+{
+  private:
+    Request _request;      // copy the script is started with after waiting
+    CGIEnvironment _env;
+    std::string _body;     // body bytes received while waiting
+    CGIHandle _backend;    // null while waiting and once the output is complete
+    bool _waiting;
+    bool _holdsSlot;
+    unsigned long _queuedAt;   // milliseconds
+
+    QueuedCGI(const QueuedCGI &cgi);
+    QueuedCGI &operator=(const QueuedCGI &cgi);
+
+    friend class CGIQueue;
+
+  public:
+    QueuedCGI(Request &request, const CGIEnvironment &env);
+    ~QueuedCGI();
+
+    void addPollFds(std::vector<pollfd> &fds, bool wantOutput) const;
+    size_t feed(const char *data, size_t len);
+    bool inputFull() const;
+    void writeInput();
+    ssize_t readOutput(char *buf, size_t size);
+    size_t available() const;
+    int outputPipe() const;
+    void terminate();
+    void touch();
+    bool timedOut(time_t now) const;
+};
+
+/**
+ * @brief Counts the running CGI requests of every location with cgi_max_concurrency and keeps
+ * the requests waiting for them in FIFO order. The first waiting request starts as soon as a
+ * running one has sent all its output, and requests that find the queue full get a 503
+ */
+class CGIQueue
+{
+  private:
+    struct Line
+    {
+        size_t running;
+        std::deque<QueuedCGI *> waiting;
+        size_t started;
+        size_t rejected;
+        size_t waited;              // requests that started after waiting
+        unsigned long waitTotal;    // milliseconds spent waiting by all of them
+        unsigned long waitLongest;
+
+        Line();
+    };
+
+    static std::map<std::string, Line> lines;
+
+    CGIQueue();
+    static std::string keyOf(const Resource &resource);
+    static bool begin(Line &line, QueuedCGI &cgi, Request &request);
+
+  public:
+    static CGIHandle enter(Request &request, const CGIEnvironment &env);
+    static bool full(const Resource &resource);
+    static void leave(QueuedCGI &cgi);
+    static void logStats();
+};
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * @file Compression.hpp
+ * @author agent (agent@local)
+ * @brief On-the-fly gzip compression of response bodies, and a cache of compressed static files
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include "responses/FileCache.hpp"
+#include "responses/ResponseCache.hpp"
+#include <deque>
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <set>
+#include <string>
+
+#define COMPRESS_CHUNK              16384
+#define COMPRESS_SYNC_MAX           262144     // bodies up to 256KB are compressed in the event loop
+#define COMPRESS_MAX_FILE           16777216   // bigger files are never compressed on the fly
+#define COMPRESSION_CACHE_MAX_BYTES 67108864   // 64MB for all compressed files
+
+bool gzipCompress(const char *data, size_t length, int level, std::string &out);
+bool gzipCompressFile(int fd, off_t size, int level, std::string &out);
+
+struct z_stream_s;
+
+/**
+ * @brief Gzips a body produced a piece at a time, such as the output of a CGI script. Every piece
+ * is flushed, so the client never waits for the next one to see it
+ */
+class GzipStream
+{
+  private:
+    z_stream_s *_stream;
+    bool _open;
+
+    GzipStream(const GzipStream &g);
+    GzipStream &operator=(const GzipStream &g);
+
+  public:
+    explicit GzipStream(int level);
+    ~GzipStream();
+
+    bool compress(const char *data, size_t length, bool last, std::string &out);
+};
+
+/**
+ * @brief Keeps the gzipped contents of static files so each version of a file is compressed only
+ * once. Files too big to compress in the event loop are compressed by a worker thread, and are
+ * sent uncompressed until the result is collected by the event loop
+ */
+class CompressionCache
+{
+  private:
+    struct Entry
+    {
+        BufferHandle data;
+        time_t mtime;
+        ino_t inode;
+        dev_t device;
+        off_t size;
+        int level;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    // A file for the worker to compress. The worker opens the file itself and checks that it is
+    // still the version the job was created for
+    struct Job
+    {
+        std::string path;
+        time_t mtime;
+        ino_t inode;
+        dev_t device;
+        off_t size;
+        int level;
+        std::string *result;   // NULL if compression failed
+    };
+
+    std::map<std::string, Entry> _entries;
+    std::list<std::string> _lru;   // most recently used path at the front
+    size_t _bytes;
+    std::set<std::string> _pending;   // paths queued for or being compressed by the worker
+
+    // shared with the worker thread, protected by _lock
+    pthread_mutex_t _lock;
+    pthread_cond_t _wake;
+    std::deque<Job> _jobs;
+    std::deque<Job> _done;
+    bool _workerStarted;
+
+    static CompressionCache cache;
+
+    CompressionCache();
+    CompressionCache(const CompressionCache &c);
+    CompressionCache &operator=(const CompressionCache &c);
+    void evict(std::map<std::string, Entry>::iterator entry);
+    static void *work(void *arg);
+
+  public:
+    size_t hits;
+    size_t misses;
+
+    static CompressionCache &getCache();
+
+    BufferHandle find(const std::string &path, const OpenFile &file, int level);
+    void insert(const std::string &path, const OpenFile &file, int level,
+                const BufferHandle &data);
+    void schedule(const std::string &path, const OpenFile &file, int level);
+    void collect();
+    void invalidate(const std::string &path);
+    void purge();
+    void logStats() const;
+};
+
+#endif
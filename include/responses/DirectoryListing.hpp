@@ -0,0 +1,158 @@
+/**
+ * @file DirectoryListing.hpp
+ * @author agent (agent@local)
+ * @brief Directory reading, cached listing pages and streamed listings of large directories
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef DIRECTORY_LISTING_HPP
+#define DIRECTORY_LISTING_HPP
+
+#include "requests/Resource.hpp"
+#include "responses/BodyStream.hpp"
+#include "responses/ResponseCache.hpp"
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#ifndef __linux__
+#include <dirent.h>
+#endif
+
+#define LISTING_BATCH           262144     // bytes of entries read per getdents64() call
+#define LISTING_BATCH_ENTRIES   4096       // entries read per batch where getdents64 is missing
+#define LISTING_CACHE_MAX_BYTES 16777216   // 16MB for all cached listings
+#define LISTING_PER_PAGE        1000       // entries per page when only `page` is given
+
+/**
+ * @brief Reads the names in a directory in large batches, with getdents64() on Linux
+ */
+class DirectoryReader
+{
+  private:
+#ifdef __linux__
+    int _fd;
+    char *_buffer;
+#else
+    DIR *_dir;
+#endif
+
+    DirectoryReader(const DirectoryReader &reader);
+    DirectoryReader &operator=(const DirectoryReader &reader);
+
+  public:
+    DirectoryReader();
+    ~DirectoryReader();
+
+    bool open(const std::string &path);
+    ssize_t read(std::vector<std::string> &names);
+};
+
+/**
+ * @brief How a listing was asked for in the query string: `sort=name`, `order=desc`, `page` and
+ * `per_page`. Unknown parameters are ignored
+ */
+struct ListingOptions
+{
+    bool sorted;
+    bool descending;
+    size_t page;      // first page is 1, 0 for the whole listing
+    size_t perPage;
+
+    ListingOptions(const std::string &query = "");
+    bool wholeDirectory() const;
+    std::string query(size_t pageNumber) const;
+};
+
+/**
+ * @brief Builds the HTML of a listing piece by piece, so the same code makes cached pages and
+ * streamed chunks
+ */
+class ListingWriter
+{
+  private:
+    std::string _title;
+    std::string _urlPrefix;
+
+  public:
+    ListingWriter(const std::string &url);
+
+    void head(std::string &html) const;
+    void entries(std::string &html, const std::vector<std::string> &names, size_t first = 0,
+                 size_t last = std::string::npos) const;
+    void tail(std::string &html, const ListingOptions &options, bool morePages) const;
+};
+
+/**
+ * @brief Keeps rendered listings until their directory changes. A directory's modification time
+ * changes whenever an entry is added, removed or renamed, so it is checked on every hit
+ */
+class ListingCache
+{
+  private:
+    struct Entry
+    {
+        BufferHandle page;
+        std::string path;
+        time_t mtime;
+        long mtimeNsec;
+        ino_t inode;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    static std::map<std::string, Entry> entries;
+    static std::list<std::string> lru;   // most recently used key at the front
+    static size_t bytes;
+
+    static void evict(std::map<std::string, Entry>::iterator entry);
+
+  public:
+    struct Version
+    {
+        time_t mtime;
+        long mtimeNsec;
+        ino_t inode;
+    };
+
+    static std::string key(const Resource &dir, const ListingOptions &options);
+    static bool version(const std::string &path, Version &version);
+    static BufferHandle find(const std::string &key, const Version &version);
+    static void insert(const std::string &key, const Version &version, const BufferHandle &page);
+};
+
+/**
+ * @brief Sends a listing while the directory is read, one batch of entries per chunk. The whole
+ * page is cached once it is complete, unless it outgrows the cache
+ */
+class DirectoryStream : public BodyStream
+{
+  private:
+    DirectoryReader _reader;
+    ListingWriter _writer;
+    std::vector<std::string> _names;   // entries read but not sent yet
+    std::string _key;
+    ListingCache::Version _version;
+    std::string _page;                 // everything sent so far, to be cached
+    bool _cacheable;
+    bool _started;
+    bool _finished;                    // the whole directory was read
+
+  public:
+    DirectoryStream(const Resource &dir, const std::string &key,
+                    const ListingCache::Version &version);
+
+    bool open(const std::string &path);
+    bool readAhead(size_t count);
+    std::vector<std::string> &names();
+    int read(std::string &out);
+};
+
+const std::string renderListing(const Resource &dir, const ListingOptions &options,
+                                std::vector<std::string> &names);
+
+#endif
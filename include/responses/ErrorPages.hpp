@@ -0,0 +1,62 @@
+/**
+ * @file ErrorPages.hpp
+ * @author agent (agent@local)
+ * @brief Error page bodies loaded once and shared by every error response
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef ERROR_PAGES_HPP
+#define ERROR_PAGES_HPP
+
+#include "config/ServerBlock.hpp"
+#include "requests/Resource.hpp"
+#include "responses/ResponseCache.hpp"
+#include <ctime>
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+#define ERROR_PAGE_REVALIDATE 1   // seconds before a page file is checked for changes
+
+/**
+ * @brief The body of an error response, either a built-in page or a configured error_page file
+ */
+struct ErrorPage
+{
+    BufferHandle body;
+    BufferHandle gzipped;   // compressed on first use, null until then
+    int gzipLevel;
+    std::string path;       // file the page was loaded from, empty for built-in pages
+    time_t mtime;
+    ino_t inode;
+    off_t size;
+    time_t validated;
+
+    ErrorPage();
+};
+
+/**
+ * @brief Keeps every error page in memory so an error response costs no disk access and no page
+ * generation. Configured pages are loaded at startup and reloaded when their file changes, and
+ * pages of deleted files fall back to the built-in page for the status code
+ */
+class ErrorPages
+{
+  private:
+    static std::map<unsigned int, ErrorPage> builtIn;
+    static std::map<std::string, ErrorPage> files;
+
+    static ErrorPage &builtInPage(unsigned int statusCode);
+    static bool load(const std::string &path, ErrorPage &page);
+    static bool stillValid(ErrorPage &page, time_t now);
+
+  public:
+    static void preload(const std::vector<ServerBlock> &config);
+    static ErrorPage &find(unsigned int statusCode, const Resource &resource);
+    static const BufferHandle &compressed(ErrorPage &page, int level);
+};
+
+#endif
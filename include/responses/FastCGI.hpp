@@ -0,0 +1,154 @@
+/**
+ * @file FastCGI.hpp
+ * @author agent (agent@local)
+ * @brief Client for FastCGI applications that run a location's CGI files instead of a fork
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef FASTCGI_HPP
+#define FASTCGI_HPP
+
+#include "cgiUtils.hpp"
+#include "config/ServerBlock.hpp"
+#include "responses/CGIBackend.hpp"
+#include <map>
+#include <sys/socket.h>
+
+#define FASTCGI_IDLE_MAX   8        // idle connections kept open per application
+#define FASTCGI_MPX_MAX    32       // requests sent at once on a connection that multiplexes
+#define FASTCGI_OUTPUT_MAX 262144   // output buffered for a request before reading pauses
+#define FASTCGI_RECORD     8        // length of a record header
+#define FASTCGI_CONTENT    65535    // longest content of one record
+
+class FastCGIRequest;
+struct FastCGIUpstream;
+
+/**
+ * @brief One connection to a FastCGI application. Requests on it are told apart by their id, so
+ * an application that can multiplex gets several at once, and the connection is kept open for
+ * the next request once the current ones are done
+ */
+class FastCGIConnection
+{
+  private:
+    int _fd;
+    bool _connecting;   // the non-blocking connect() has not completed yet
+    std::string _out;   // records not written yet
+    size_t _outStart;
+    std::string _in;    // bytes of an incomplete record
+    unsigned short _nextId;
+
+    FastCGIConnection(const FastCGIConnection &connection);
+    FastCGIConnection &operator=(const FastCGIConnection &connection);
+    void dispatch(unsigned char type, unsigned short id, const char *content, size_t len);
+    void readValues(const char *content, size_t len);
+    bool backedUp() const;
+
+  public:
+    FastCGIUpstream &upstream;
+    std::map<unsigned short, FastCGIRequest *> requests;   // NULL for aborted requests
+    bool multiplexes;   // the application reported FCGI_MPXS_CONNS=1
+    pid_t worker;       // process at the other end of a cgi_pool connection, -1 otherwise
+    size_t served;      // requests sent on the connection
+
+    FastCGIConnection(FastCGIUpstream &app, int fd, bool connecting);
+    ~FastCGIConnection();
+
+    int fd() const;
+    bool connecting() const;
+    short pollEvents() const;
+    size_t pending() const;
+    bool retired() const;
+    unsigned short reserveId();
+    void queue(unsigned char type, unsigned short id, const char *data, size_t len);
+    void queueParams(unsigned short id, const CGIEnvironment &env, const std::string &scriptPath);
+    bool flush();
+    bool receive();
+    bool finishConnect();
+};
+
+/**
+ * @brief A FastCGI application given by fastcgi_pass, or the workers of a cgi_pool, and their
+ * open connections
+ */
+struct FastCGIUpstream
+{
+    sockaddr_storage address;
+    socklen_t length;
+    std::string program;   // worker program of a cgi_pool, empty for fastcgi_pass
+    size_t workers;
+    size_t maxRequests;    // requests per worker before it is replaced, 0 for no limit
+    std::vector<FastCGIConnection *> connections;
+};
+
+/**
+ * @brief A request sent to a FastCGI application. Its body goes out as FCGI_STDIN records as it
+ * arrives from the client, and the application's FCGI_STDOUT records are collected until the
+ * response reads them
+ */
+class FastCGIRequest : public CGIBackend
+{
+  private:
+    FastCGIConnection *_connection;   // NULL once the request ended or the connection closed
+    unsigned short _id;
+    std::string _output;   // FCGI_STDOUT content not read yet
+    size_t _outputStart;
+    bool _ended;
+
+    FastCGIRequest(const FastCGIRequest &request);
+    FastCGIRequest &operator=(const FastCGIRequest &request);
+    void sendBody(const char *data, size_t len);
+    void abort();
+
+  public:
+    FastCGIRequest(FastCGIConnection &connection, Request &request, const CGIEnvironment &env);
+    ~FastCGIRequest();
+
+    void addPollFds(std::vector<pollfd> &fds, bool wantOutput) const;
+    size_t feed(const char *data, size_t len);
+    bool inputFull() const;
+    void writeInput();
+    ssize_t readOutput(char *buf, size_t size);
+    void terminate();
+
+    size_t buffered() const;
+    void addOutput(const char *data, size_t len);
+    void end();
+    void connectionLost();
+};
+
+/**
+ * @brief Keeps the connections to every FastCGI application in use, and the worker processes of
+ * every cgi_pool. Workers get one end of a socket pair as their stdin and stdout and speak
+ * FastCGI on it, so they are used like any other connection. The connections are polled by the
+ * server's event loop together with the clients
+ */
+class FastCGIClient
+{
+  private:
+    static std::map<std::string, FastCGIUpstream> upstreams;
+    static std::map<int, FastCGIConnection *> connections;
+    static size_t pollStart;
+    static size_t pollCount;
+
+    FastCGIClient();
+    static FastCGIUpstream *findUpstream(const std::string &address);
+    static FastCGIConnection *connect(FastCGIUpstream &upstream);
+    static FastCGIConnection *spawnWorker(FastCGIUpstream &pool);
+    static FastCGIConnection *pickConnection(FastCGIUpstream &upstream);
+    static void close(FastCGIConnection *connection);
+
+  public:
+    static std::string upstreamOf(const Route &route);
+    static void startPools(serverList servers);
+    static void maintainPools();
+    static CGIHandle start(const std::string &address, Request &request,
+                           const CGIEnvironment &env);
+    static void addPollFds(std::vector<pollfd> &fds);
+    static void update(const std::vector<pollfd> &fds);
+};
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file FileCache.hpp
+ * @author agent (agent@local)
+ * @brief LRU cache of open read-only file descriptors for static files
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef FILE_CACHE_HPP
+#define FILE_CACHE_HPP
+
+#include "SharedPtr.hpp"
+#include "config/ServerBlock.hpp"
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+#define FD_RESERVE 256   // fds kept free for client sockets, CGI pipes and config/error files
+
+/**
+ * @brief A file opened for reading along with the metadata needed to respond with it.
+ * The descriptor is closed when the last handle to it is released
+ */
+struct OpenFile
+{
+    int fd;
+    off_t size;
+    time_t mtime;
+    ino_t inode;
+    dev_t device;
+    std::string mimeType;
+
+    OpenFile();
+    ~OpenFile();
+
+    // Number of descriptors currently held open by OpenFile objects
+    static size_t openCount;
+
+  private:
+    OpenFile(const OpenFile &file);
+    OpenFile &operator=(const OpenFile &file);
+};
+
+typedef SharedPtr<OpenFile> FileHandle;
+
+/**
+ * @brief Keeps recently served files open so that repeated requests skip the open/fstat/close
+ * syscalls. Entries are revalidated against the file's inode and mtime once every `valid` seconds
+ */
+class FileCache
+{
+  private:
+    struct Entry
+    {
+        FileHandle file;
+        time_t validated;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    std::map<std::string, Entry> _entries;
+    std::list<std::string> _lru;                // most recently used path at the front
+    std::map<std::string, time_t> _missing;   // paths found missing, and when
+    size_t _maxEntries;
+    time_t _validSecs;
+
+    static std::map<std::string, FileCache> caches;   // one cache per location root
+
+    void evict(std::map<std::string, Entry>::iterator entry);
+    bool evictOldest();
+    bool stillValid(Entry &entry, time_t now);
+
+  public:
+    FileCache();
+    void configure(size_t maxEntries, time_t validSecs);
+    FileHandle open(const std::string &path, bool rememberMissing = false);
+    void invalidate(const std::string &path);
+    size_t size() const;
+    void clear();
+
+    // Opens a file through the cache of the route it belongs to, or uncached if the route
+    // has no `open_file_cache` configured. With rememberMissing, a missing file is remembered
+    // for `valid` seconds, for optional files that are looked up on every request
+    static FileHandle open(const std::string &path, const Route &route,
+                           bool rememberMissing = false);
+    static FileHandle openUncached(const std::string &path);
+    static void invalidate(const std::string &path, const Route &route);
+    static size_t fdBudget();
+};
+
+#endif
@@ -8,7 +8,35 @@
  *
  */
 
+#include <ctime>
 #include <iostream>
+#include <sys/types.h>
+#include <vector>
 
-std::string getStatus(int statusCode);
+#define ETAG_MAX          64   // buffer size for formatETag()
+#define HTTP_DATE_MAX     32   // buffer size for formatHTTPDate()
+#define CONTENT_RANGE_MAX 64   // buffer size for formatContentRange()
+#define RANGES_MAX        16   // requests with more ranges get the whole file
+
+// results of parseRanges()
+#define RANGE_IGNORED       0   // missing or malformed, the whole file is sent
+#define RANGE_SATISFIABLE   1
+#define RANGE_UNSATISFIABLE 2
+
+struct OpenFile;
+
+struct ByteRange
+{
+    off_t start;
+    off_t end;   // one past the last byte
+};
+
+const char *getStatus(int statusCode);
 std::string getContentType(std::string filename);
+size_t formatETag(const OpenFile &file, char *buffer);
+size_t formatHTTPDate(time_t date, char *buffer);
+time_t parseHTTPDate(const std::string &date);
+bool etagListMatches(const std::string &list, const char *etag, size_t etagLen);
+int parseRanges(const std::string &value, off_t size, std::vector<ByteRange> &ranges);
+size_t formatContentRange(const ByteRange *range, off_t size, char *buffer);
+bool acceptsEncoding(const std::string &list, const std::string &coding);
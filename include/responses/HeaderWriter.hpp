@@ -0,0 +1,69 @@
+/**
+ * @file HeaderWriter.hpp
+ * @author agent (agent@local)
+ * @brief Writer for response heads
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef HEADER_WRITER_HPP
+#define HEADER_WRITER_HPP
+
+#include <cstddef>
+#include <ctime>
+#include <string>
+
+#define HEADER_MAX      2048   // response heads longer than this move to the heap
+#define SERVER_SOFTWARE "Webserv/1.1"
+#define NO_EXPIRES      -1     // no Expires line in the preamble
+
+/**
+ * @brief Formats a response head into an inline buffer without allocating, unless the head
+ * outgrows it. The Date and Server lines are shared by all responses, with the Date line
+ * regenerated at most once per second by the event loop
+ */
+class HeaderWriter
+{
+  private:
+    char _buffer[HEADER_MAX];
+    size_t _length;
+    size_t _preambleEnd;
+    std::string _overflow;   // the whole head once it is longer than HEADER_MAX
+
+    static char dateLine[64];
+    static size_t dateLineLen;
+    static time_t dateTime;
+    static char expiresLine[64];   // last Expires line formatted, reused within the same second
+    static size_t expiresLineLen;
+    static time_t expiresTime;
+
+    void append(const char *str, size_t len);
+    void appendDate(long expires);
+
+  public:
+    HeaderWriter();
+    HeaderWriter(const HeaderWriter &w);
+    HeaderWriter &operator=(const HeaderWriter &w);
+
+    const char *data() const;
+    size_t length() const;
+    void reset();
+
+    size_t preambleEnd() const;
+
+    void preamble(int statusCode, long expires = NO_EXPIRES);
+    void statusLine(int statusCode, long expires = NO_EXPIRES);
+    void statusLine(const std::string &status);
+    void line(const char *line, size_t len);
+    void header(const char *name, const char *value);
+    void header(const char *name, const char *value, size_t len);
+    void header(const char *name, const std::string &value);
+    void header(const char *name, size_t value);
+    void end();
+
+    static void updateDate(time_t now);
+};
+
+#endif
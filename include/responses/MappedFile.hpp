@@ -0,0 +1,61 @@
+/**
+ * @file MappedFile.hpp
+ * @author agent (agent@local)
+ * @brief Read-only memory mappings of static files shared by concurrent downloads
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include "SharedPtr.hpp"
+#include "responses/FileCache.hpp"
+#include <map>
+#include <string>
+#include <sys/uio.h>
+
+#define MMAP_MAX_FILE 16777216   // files between RESPONSE_CACHE_MAX_FILE and 16MB are mapped,
+                                 // bigger ones are sent with sendfile()
+
+/**
+ * @brief A whole file mapped into memory. Unmapped when the last handle is released
+ */
+struct MappedFile
+{
+    char *data;
+    size_t length;
+    time_t mtime;
+    ino_t inode;
+    dev_t device;
+    bool faulted;   // a write from it failed because the file was truncated
+
+    MappedFile();
+    ~MappedFile();
+
+  private:
+    MappedFile(const MappedFile &file);
+    MappedFile &operator=(const MappedFile &file);
+};
+
+typedef SharedPtr<MappedFile> MappingHandle;
+
+/**
+ * @brief Keeps one mapping per file for as long as a response is sending it, so many clients
+ * downloading the same file share a single mapping and page cache readahead
+ */
+class MappingCache
+{
+  private:
+    static std::map<std::string, MappingHandle> mappings;
+
+    static void dropUnused();
+
+  public:
+    static MappingHandle map(const std::string &path, const OpenFile &file);
+    static ssize_t guardedWritev(int fd, const struct iovec *iov, int count);
+};
+
+#endif
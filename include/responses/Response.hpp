@@ -12,7 +12,14 @@
 #define RESPONSE_HPP
 
 #include "HeaderData.hpp"
+#include "HeaderWriter.hpp"
+#include "cgiUtils.hpp"
 #include "logger/Logger.hpp"
+#include "responses/BodyStream.hpp"
+#include "responses/CGIBackend.hpp"
+#include "responses/FileCache.hpp"
+#include "responses/MappedFile.hpp"
+#include "responses/ResponseCache.hpp"
 #include "network/network.hpp"
 #include "requests/Request.hpp"
 #include <cstddef>
@@ -20,7 +27,9 @@
 #include <ios>
 #include <iostream>
 #include <sstream>
+#include <sys/types.h>
 #include <sys/wait.h>
+#include <vector>
 
 #define IDLE_CONNECTION 0
 #define SEND_FAIL       1
@@ -34,17 +43,70 @@
 #define CONTENT_LEN  "Content-Length: "
 #define LOCATION     "Location: "
 #define KEEP_ALIVE   "Connection: keep-alive"
+#define ETAG          "ETag: "
+#define LAST_MODIFIED "Last-Modified: "
+#define CONTENT_RANGE "Content-Range: "
+#define ACCEPT_RANGES "Accept-Ranges: bytes"
+#define CONTENT_ENC   "Content-Encoding: "
+#define VARY_ENCODING "Vary: Accept-Encoding"
+#define CHUNKED       "Transfer-Encoding: chunked"
+#define RETRY_AFTER   "Retry-After: "
 
 // content types
 #define HTML       "text/html; charset=UTF-8"
+#define BYTERANGES "multipart/byteranges; boundary="
 #define NO_CONTENT ""
 
 struct Headers
 {
     int statusCode;
-    std::string contentType;
+    const char *contentType;
     size_t contentLen;
     bool keepAlive;
+    const OpenFile *file;          // file whose validators are sent, NULL if none
+    const char *contentEncoding;   // NULL if the body is not encoded
+    bool vary;                     // whether the body depends on Accept-Encoding
+    bool weakETag;                 // body is compressed on the fly, so it is not byte-identical
+                                   // to the file its ETag is made from
+    const CachePolicy *cachePolicy;   // Cache-Control and Expires to send, NULL if none
+    bool chunked;                     // body is streamed, its length is unknown
+    unsigned int retryAfter;          // seconds sent in Retry-After, 0 if none
+};
+
+/**
+ * @brief The file chosen to answer a request for a static file: the file itself, or a
+ * precompressed copy of it that the client accepts
+ */
+struct Representation
+{
+    FileHandle file;
+    std::string path;
+    std::string mimeType;   // type of the requested file, also used for precompressed copies
+    const char *encoding;   // NULL for the file itself
+    bool vary;              // whether precompressed or compressed copies may be sent
+    bool weakETag;          // whether the file is compressed on the fly if it is sent whole
+    const CachePolicy *cachePolicy;   // caching headers of the requested file, NULL if none
+};
+
+/**
+ * @brief One piece of a response. The bytes come from exactly one of a shared buffer, a shared
+ * file mapping, an open file or a CGI script's output pipe, so headers, bodies and cached
+ * responses are sent in place instead of being copied into one contiguous buffer. The head of
+ * the response is a segment pointing into the response's own HeaderWriter
+ */
+struct Segment
+{
+    bool head;               // bytes are the response head
+    BufferHandle buffer;     // bytes generated in memory or shared with the response cache
+    MappingHandle mapping;   // bytes of a mapped file
+    FileHandle file;         // file sent with sendfile(), for bodies that are not in memory
+    int pipe;                // CGI output pipe the bytes are spliced from, -1 if none
+    off_t offset;            // next byte to send
+    off_t end;
+
+    Segment();
+    const char *data() const;
+    bool inMemory() const;
 };
 
 using logger::Log;
@@ -52,37 +114,78 @@ class Response
 {
     // using Logger::log;
   private:
-    char *_buffer;
-    size_t _length;
+    HeaderWriter _head;
+    std::vector<Segment> _segments;
+    size_t _current;   // first segment that is not fully sent yet
+    size_t _length;    // bytes in all segments
     size_t _totalBytesSent;
     int _statusCode;
+    int _htmlCompressLevel;   // 0 if generated pages are not compressed for this request
+    size_t _htmlCompressMinLength;
+    StreamHandle _stream;   // produces the rest of the body, null once it is complete
+    CGIHandle _cgi;         // script whose output becomes the response, null if none is running
+
+    void addSegment(const Segment &segment);
+    void addHead();
+    void addBuffer(const BufferHandle &buffer);
+    void addMapping(const MappingHandle &mapping, off_t offset, off_t end);
+    void addFile(const FileHandle &file, off_t offset, off_t end);
+    void addFileBody(const Representation &rep, off_t offset, off_t end);
+    void addStream(const StreamHandle &stream);
+    void addChunk(const BufferHandle &chunk, bool last);
+    int pullStream();
+    void advance(size_t bytesSent);
+    ssize_t writeSegments(int fd);
+    ssize_t sendFileSegment(int fd);
+    ssize_t spliceSegment(int fd);
+    void writeHeaders(const Headers &h);
+    bool createCachedResponse(const std::string &cacheKey, const CachePolicy *policy);
+    bool createNotModifiedResponse(Request &request, const Representation &rep);
+    bool createRangeResponse(Request &request, const Representation &rep);
+    void createMultipartResponse(Request &request, const Representation &rep,
+                                 const std::vector<ByteRange> &ranges);
+    bool createCachedGETResponse(Request &request, const Representation &rep,
+                                 const std::string &cacheKey);
+    bool createCompressedGETResponse(Request &request, const Representation &rep);
+    void failCGI(int statusCode);
+    void addCGIBody(const BufferHandle &body, bool last);
+    void startCGIBody(size_t headerEnd, size_t bodyStart, bool complete);
+    void readCGIHeaders();
+    int pullCGIOutput();
 
   public:
     Response();
     Response(const Response &r);
     Response &operator=(const Response &r);
-    char *buffer();
     size_t length();
     size_t totalBytesSent();
     int statusCode();
 
+    bool hasOutput() const;
     int sendResponse(int fd);
-    void setResponse(std::stringstream &ss);
-    void setResponseHeaders(std::stringstream &ss, Headers header);
+    void setResponseHeaders(const Headers &h);
+    void negotiateCompression(Request &request);
     void createRedirectResponse(std::string &redirUrl, int statusCode, bool keepAlive);
     void createGETResponse(Request &request);
     void createFileResponse(Request &request, int statusCode);
     void createDELETEResponse(Request &request);
     void createHEADFileResponse(Request &request);
-    void createHEADResponse(int statusCode, std::string contentType, bool keepAlive);
+    void createHEADResponse(int statusCode, const char *contentType, bool keepAlive);
     void createHTMLResponse(int statusCode, std::string page, bool keepAlive);
+    void createHTMLResponse(int statusCode, const BufferHandle &page, bool keepAlive);
+    void createListingResponse(Request &request);
+    void createErrorResponse(int statusCode, const Resource &resource, bool keepAlive,
+                             unsigned int retryAfter = 0);
     void trimBody();
 
     // CGI
-    int sendCGIRequestBody(int pipeFd, Request &req);
-    void readCGIResponse(Request &req);
-    void runCGI(int p[2], int outFd, Request &req, std::vector<char *> env);
-    void createCGIResponse(Request &request, std::vector<char *> env);
+    void createCGIResponse(Request &request, const CGIEnvironment &env);
+    bool runningCGI() const;
+    void addCGIPollFds(std::vector<pollfd> &fds) const;
+    size_t feedCGI(const char *data, size_t len);
+    bool cgiInputFull() const;
+    void updateCGI(time_t now);
+    void cancelCGI();
 
     void clear();
     ~Response();
@@ -0,0 +1,78 @@
+/**
+ * @file ResponseCache.hpp
+ * @author agent (agent@local)
+ * @brief In-memory cache of complete serialized responses for small static files
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include "SharedPtr.hpp"
+#include "responses/FileCache.hpp"
+#include <ctime>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#define RESPONSE_CACHE_MAX_BYTES  33554432   // 32MB for all cached responses
+#define RESPONSE_CACHE_MAX_FILE   65536      // only files up to 64KB are cached
+#define RESPONSE_CACHE_REVALIDATE 1          // seconds before an entry is checked against disk
+
+typedef SharedPtr<std::string> BufferHandle;
+
+/**
+ * @brief Stores the exact bytes sent for a static file (headers after the Date line, and the body)
+ * so a repeated request can be answered with a single writev() from memory shared by all
+ * connections. Entries are evicted with the CLOCK algorithm once the size limit is reached
+ */
+class ResponseCache
+{
+  private:
+    struct Entry
+    {
+        BufferHandle response;
+        std::string path;
+        time_t mtime;
+        ino_t inode;
+        off_t size;
+        time_t validated;
+        bool referenced;   // CLOCK bit, set on every hit and cleared when the hand passes
+        size_t slot;       // position in the clock ring
+    };
+
+    std::map<std::string, Entry> _entries;
+    std::vector<std::string> _ring;   // keys in clock order, empty strings are free slots
+    std::vector<size_t> _freeSlots;
+    size_t _hand;
+    size_t _bytes;
+
+    static ResponseCache cache;
+
+    ResponseCache();
+    bool stillValid(Entry &entry, time_t now);
+    void evict(std::map<std::string, Entry>::iterator entry);
+    void evictOne();
+
+  public:
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+
+    static ResponseCache &getCache();
+    static std::string key(unsigned int port, const std::string &host, const std::string &path,
+                           bool keepAlive);
+
+    BufferHandle find(const std::string &key);
+    void insert(const std::string &key, const std::string &path, const OpenFile &file,
+                const BufferHandle &response);
+    void invalidate(const std::string &path);
+    void purge();
+    void logStats() const;
+};
+
+#endif
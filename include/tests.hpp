@@ -22,4 +22,10 @@ void inputValidatorTests();
  */
 void chunkerTests();
 
+/**
+ * @brief Tests for the pure functions behind responses: Range parsing, CGI header parsing, the
+ * CGI cache check and the response head writer
+ */
+void responseTests();
+
 #endif
@@ -169,14 +169,6 @@ bool isFile(const std::string &path);
  */
 bool isDir(const std::string &path);
 
-/**
- * @brief Converts an HTTP header key to a string for use with a CGI env variable
- *
- * @param header HTTP header to convert
- * @return std::string Converted header
- */
-std::string headerToEnv(const std::string &header);
-
 /**
  * @brief Get the directory component from a pathname
  *
@@ -193,4 +185,22 @@ std::string dirName(const std::string &path);
  */
 std::string baseName(const std::string &path);
 
+/**
+ * @brief Convert a duration like `30s`, `5m`, `2h` or `30d` to seconds. A number without a unit is
+ * treated as seconds. The duration is expected to have been validated with validateDuration
+ *
+ * @param duration Duration string
+ * @return size_t The duration in seconds
+ */
+size_t durationToSeconds(const std::string &duration);
+
+/**
+ * @brief Convert a size like `512k`, `256M` or `1g` to bytes. A number without a unit is treated as
+ * bytes. The size is expected to have been validated with validateSize
+ *
+ * @param size Size string
+ * @return size_t The size in bytes
+ */
+size_t sizeToBytes(const std::string &size);
+
 #endif
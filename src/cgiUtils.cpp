@@ -10,8 +10,12 @@
 
 #include "cgiUtils.hpp"
 #include "logger/Logger.hpp"
+#include "responses/HeaderData.hpp"
+#include "responses/HeaderWriter.hpp"
 #include "utils.hpp"
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
@@ -19,13 +23,76 @@
 #include <exception>
 #include <libgen.h>
 #include <signal.h>
+#include <spawn.h>
+#include <sstream>
 #include <stdlib.h>
+#include <strings.h>
 #include <sys/fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-void addToEnv(std::vector<char *> &env, std::string var)
+std::map<unsigned int, std::string> CGIEnvironment::staticBlocks =
+    std::map<unsigned int, std::string>();
+
+/**
+ * @brief Starts an environment with the variables that only depend on the port the request came
+ * in on
+ */
+CGIEnvironment::CGIEnvironment(unsigned int port) : _block()
+{
+    std::map<unsigned int, std::string>::iterator it = staticBlocks.find(port);
+
+    if (it == staticBlocks.end())
+    {
+        add("SERVER_SOFTWARE", SERVER_SOFTWARE);
+        add("GATEWAY_INTERFACE", "CGI/1.1");
+        add("SERVER_PROTOCOL", "HTTP/1.1");
+        add("SERVER_PORT", toStr(port));
+        it = staticBlocks.insert(std::make_pair(port, _block)).first;
+    }
+    _block.reserve(CGI_ENV_RESERVE);
+    _block.assign(it->second);
+}
+
+void CGIEnvironment::add(const char *name, const std::string &value)
+{
+    _block.append(name).append(1, '=').append(value).append(1, '\0');
+}
+
+/**
+ * @brief Adds a request header as HTTP_ followed by its name in upper case with '-' replaced by
+ * '_'
+ */
+void CGIEnvironment::addHeader(const std::string &header, const std::string &value)
 {
-    env.push_back(strdup(var.c_str()));
+    _block.append("HTTP_");
+    for (size_t i = 0; i < header.size(); i++)
+        _block.append(1, header[i] == '-' ? '_' : static_cast<char>(::toupper(header[i])));
+    _block.append(1, '=').append(value).append(1, '\0');
+}
+
+const std::string &CGIEnvironment::block() const
+{
+    return _block;
+}
+
+/**
+ * @brief The variables as the NULL terminated array execve() takes, pointing into the block
+ */
+std::vector<char *> CGIEnvironment::envp() const
+{
+    std::vector<char *> env;
+    char *variable = const_cast<char *>(_block.data());
+    char *const end = variable + _block.size();
+
+    while (variable != end)
+    {
+        env.push_back(variable);
+        variable += strlen(variable) + 1;
+    }
+    env.push_back(NULL);
+    return env;
 }
 
 std::string getCGIVirtualPath(const Resource &res)
@@ -37,16 +104,17 @@ std::string getCGIVirtualPath(const Resource &res)
     return res.originalRequest.substr(0, pos + cgiFileName.length());
 }
 
-void addHeadersToEnv(std::vector<char *> &env, headMap map)
+void addHeadersToEnv(CGIEnvironment &env, const headMap &map)
 {
-    if (map.count("content-type"))
-        addToEnv(env, "CONTENT_TYPE=" + map.at("content-type"));
-    if (map.count("content-length"))
-        addToEnv(env, "CONTENT_LENGTH=" + map.at("content-length"));
-    for (headMap::iterator it = map.begin(); it != map.end(); it++)
-        if (it->first != "content-type" && it->first != "content-length")
-            addToEnv(env, headerToEnv(it->first) + "=" + it->second);
-    env.push_back(NULL);
+    for (headMap::const_iterator it = map.begin(); it != map.end(); it++)
+    {
+        if (it->first == "content-type")
+            env.add("CONTENT_TYPE", it->second);
+        else if (it->first == "content-length")
+            env.add("CONTENT_LENGTH", it->second);
+        else
+            env.addHeader(it->first, it->second);
+    }
 }
 
 /*
@@ -57,11 +125,11 @@ everything after SCRIPT_NAME in original request PATH_TRANSLATED: The virtual-to
 of PATH_INFO URL: The full URI of the current request. It is made of the concatenation of
 SCRIPT_NAME and PATH_INFO (if available.) - in our case original request
 */
-void addPathEnv(std::vector<char *> &env, const Resource &res)
+void addPathEnv(CGIEnvironment &env, const Resource &res)
 {
     std::string scriptName = getCGIVirtualPath(res);
-    addToEnv(env, "SCRIPT_NAME=" + scriptName);
-    addToEnv(env, "SCRIPT_FILENAME=" + baseName(res.path));
+    env.add("SCRIPT_NAME", scriptName);
+    env.add("SCRIPT_FILENAME", baseName(res.path));
     // std::string pathInfo = res.originalRequest.substr(scriptName.length());
     std::string pathInfo = res.originalRequest;
     if (pathInfo.length() != 0)
@@ -69,93 +137,348 @@ void addPathEnv(std::vector<char *> &env, const Resource &res)
         size_t queryStart = pathInfo.find("?");
         if (queryStart != std::string::npos)
         {
-            addToEnv(env, "QUERY_STRING=" + pathInfo.substr(queryStart + 1));
+            env.add("QUERY_STRING", pathInfo.substr(queryStart + 1));
             pathInfo = pathInfo.substr(0, queryStart);
         }
         if (pathInfo.length() != 0)
         {
-            addToEnv(env, "PATH_INFO=" + pathInfo);
-            addToEnv(env, "PATH_TRANSLATED=." + pathInfo);
+            env.add("PATH_INFO", pathInfo);
+            env.add("PATH_TRANSLATED", "." + pathInfo);
         }
     }
-    addToEnv(env, "REQUEST_URI=" + pathInfo);
-    addToEnv(env, "URL=" + scriptName + pathInfo);
+    env.add("REQUEST_URI", pathInfo);
+    env.add("URL", scriptName + pathInfo);
+}
+
+std::vector<char *> createExecArgs(std::string path)
+{
+    std::vector<char *> args;
+    args.push_back(strdup(path.c_str()));
+    args.push_back(NULL);
+    return args;
 }
 
-pid_t waitCGI(pid_t pid, int &status, int &sendErrCode)
+// glibc gives the RLIMIT_ constants an enum type of their own in C++
+template <typename Resource>
+static bool setLimit(Resource resource, rlim_t soft, rlim_t extraHard)
 {
-    time_t startTime;
-    time_t curTime;
-    pid_t waitStatus;
+    rlimit limit;
 
-    waitStatus = waitpid(pid, &status, WNOHANG);
-    time(&startTime);
-    while (waitStatus == 0)
+    if (soft == 0)
+        return true;
+    limit.rlim_cur = soft;
+    limit.rlim_max = soft + extraHard;
+    return setrlimit(resource, &limit) == 0;
+}
+
+/**
+ * @brief Entry point of the server when it is started as the limits wrapper of a script, which
+ * is when CGI_LIMITS_ENV is set. It joins the location's cgroup and sets its resource limits on
+ * itself, then becomes the script, so the script never runs a single instruction without them.
+ * Its arguments, environment, directory and pipes were already set up for the script by
+ * posix_spawn(), only CGI_LIMITS_ENV is removed. Nothing is written to stdout, which is the
+ * script's output pipe
+ *
+ * @param argv The script's arguments
+ * @return int Only returns if the script could not be started
+ */
+int execWithCGILimits(char **argv)
+{
+    // the cpu, as, nofile and nproc limits (0 for none), then the cgroup (empty for none)
+    std::istringstream limits(getenv(CGI_LIMITS_ENV));
+    rlim_t cpu = 0, addressSpace = 0, openFiles = 0, processes = 0;
+    std::string cgroup;
+
+    limits >> cpu >> addressSpace >> openFiles >> processes;
+    limits.ignore();
+    std::getline(limits, cgroup);
+    unsetenv(CGI_LIMITS_ENV);
+    if (!cgroup.empty())
     {
-        waitStatus = waitpid(pid, &status, WNOHANG);
-        time(&curTime);
-        // gateway timed out, we waited for the cgi for too long;
-        if (curTime - startTime > GATEWAY_TIMEOUT)
+        const std::string procs = cgroup + "/cgroup.procs";
+        const std::string pid = toStr(getpid());
+        const int fd = open(procs.c_str(), O_WRONLY);
+        if (fd == -1 || write(fd, pid.data(), pid.size()) != static_cast<ssize_t>(pid.size()))
         {
-            Log(ERR) << "CGI Error (504): WAITPID timed out" << std::endl;
-            sendErrCode = 504;
-            kill(pid, SIGTERM);   // terminating the cgi process explicitly to prevent it from
-                                  // becoming a zombie
-            break;
+            std::cerr << "webserv: cannot join cgroup " << cgroup << ": " << strerror(errno)
+                      << std::endl;
+            return EXIT_FAILURE;
         }
+        close(fd);
     }
-    return waitStatus;
+    // SIGXCPU comes first, and SIGKILL a second later for scripts that catch it
+    if (!setLimit(RLIMIT_CPU, cpu, 1) || !setLimit(RLIMIT_AS, addressSpace, 0) ||
+        !setLimit(RLIMIT_NOFILE, openFiles, 0) || !setLimit(RLIMIT_NPROC, processes, 0))
+    {
+        std::cerr << "webserv: cannot limit " << argv[0] << ": " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    execv(argv[0], argv);
+    std::cerr << "webserv: cannot execute " << argv[0] << ": " << strerror(errno) << std::endl;
+    return EXIT_FAILURE;
 }
 
-int checkCGIError(pid_t pid, int sendErrCode, int waitStatus, int status)
+#ifdef __linux__
+/**
+ * @brief Writes a value to one of the control files of a cgroup
+ */
+static bool writeCgroupFile(const std::string &path, const std::string &value)
 {
-    if (sendErrCode != 0)
+    const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+
+    if (fd == -1)
+        return false;
+    const ssize_t bytesWritten = write(fd, value.data(), value.size());
+
+    close(fd);
+    return bytesWritten == static_cast<ssize_t>(value.size());
+}
+
+/**
+ * @brief Creates the cgroup of a location and sets its limits, the first time one of its scripts
+ * starts. The parent cgroup must have the cpu and memory controllers enabled for its children.
+ * Locations sharing a cgroup share the limits of the first one
+ *
+ * @return true if scripts can be moved to the cgroup
+ */
+static bool prepareCgroup(const CGILimits &limits)
+{
+    static std::map<std::string, bool> prepared;
+    std::map<std::string, bool>::const_iterator it = prepared.find(limits.cgroup);
+
+    if (it != prepared.end())
+        return it->second;
+    bool ready = mkdir(limits.cgroup.c_str(), 0755) == 0 || errno == EEXIST;
+    // the quota is given per period of 100ms
+    if (ready && limits.cgroupCPU != 0)
+        ready = writeCgroupFile(limits.cgroup + "/cpu.max",
+                                toStr(limits.cgroupCPU * 1000) + " 100000");
+    if (ready && limits.cgroupMemory != 0)
+        ready = writeCgroupFile(limits.cgroup + "/memory.max", toStr(limits.cgroupMemory));
+    if (!ready)
+        Log(ERR) << "CGI cgroup " << limits.cgroup << ": " << strerror(errno)
+                 << ", its scripts will not be started" << std::endl;
+    prepared[limits.cgroup] = ready;
+    return ready;
+}
+
+/**
+ * @brief Gives the limits wrapper a location's resource limits, as the CGI_LIMITS_ENV variable
+ * of the environment it is started with. The wrapper is this server's own binary, found through
+ * /proc/self/exe
+ *
+ * @param marker Set to the variable, left empty if the location has no limits
+ * @return false if the location's cgroup cannot be used
+ */
+static bool addLimitsWrapper(const CGILimits &limits, std::string &marker)
+{
+    if (limits.cpu == 0 && limits.addressSpace == 0 && limits.openFiles == 0 &&
+        limits.processes == 0 && limits.cgroup.empty())
+        return true;
+    if (!limits.cgroup.empty() && !prepareCgroup(limits))
+        return false;
+    std::ostringstream variable;
+    variable << CGI_LIMITS_ENV << '=' << limits.cpu << ' ' << limits.addressSpace << ' '
+             << limits.openFiles << ' ' << limits.processes << ' ' << limits.cgroup;
+    marker = variable.str();
+    return true;
+}
+#else
+// cgroups and /proc/self/exe only exist on Linux, the limits are ignored elsewhere
+static bool addLimitsWrapper(const CGILimits &limits, std::string &marker)
+{
+    (void)limits;
+    (void)marker;
+    return true;
+}
+#endif
+
+/**
+ * @brief Creates the script's stdin and stdout pipes and starts the script in its directory with
+ * posix_spawn(). Unlike fork(), the server's memory is not copied for a child that only moves
+ * the pipes and calls execve(), so starting a script costs the same however much the server has
+ * cached. Our ends are close-on-exec so other scripts do not inherit them and see the end of
+ * their pipes when we close them. The script leads a new process group, which is what is
+ * signalled to stop it. Scripts of locations with `cgi_limits` are started through the limits
+ * wrapper
+ *
+ * @param path Path of the script
+ * @param limits Resource limits of the script's location
+ * @return pid_t The script's pid, or -1 if it could not be started
+ */
+pid_t startCGIProcess(const std::string &path, const CGIEnvironment &env, const CGILimits &limits,
+                      int in[2], int out[2])
+{
+    if (pipe(in) == -1)
+        return -1;
+    if (pipe(out) == -1)
     {
-        Log(ERR) << "CGI error " << sendErrCode << std::endl;
-        return sendErrCode;
+        close(in[0]);
+        close(in[1]);
+        return -1;
     }
-    if (waitStatus == -1)
+    for (int i = 0; i < 2; i++)
     {
-        Log(ERR) << "CGI error 502: waitpid returned error" << std::endl;
-        return 502;   // bad gateway
+        fcntl(in[i], F_SETFD, FD_CLOEXEC);
+        fcntl(out[i], F_SETFD, FD_CLOEXEC);
     }
-    if (waitStatus == pid && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE)
+    const std::string filename = "./" + baseName(path);
+    std::vector<char *> args = createExecArgs(filename);
+    std::vector<char *> envp = env.envp();
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attributes;
+    std::string marker;
+    pid_t pid;
+
+    if (!addLimitsWrapper(limits, marker))
     {
-        Log(ERR) << "CGI error 502: process " << pid << " exited with error" << std::endl;
-        return 502;
+        std::for_each(args.begin(), args.end(), free);
+        for (int i = 0; i < 2; i++)
+        {
+            close(in[i]);
+            close(out[i]);
+        }
+        return -1;
     }
-    return EXIT_SUCCESS;
+    // a limited script is started by the wrapper, which finds its limits in its environment
+    if (!marker.empty())
+        envp.insert(envp.end() - 1, const_cast<char *>(marker.c_str()));
+    const char *program = marker.empty() ? filename.c_str() : "/proc/self/exe";
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addchdir_np(&actions, dirName(path).c_str());
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    const int error =
+        posix_spawn(&pid, program, &actions, &attributes, &args[0], &envp[0]);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    std::for_each(args.begin(), args.end(), free);
+    // only the script reads from the input pipe and writes to the output pipe
+    close(in[0]);
+    close(out[1]);
+    if (error == 0)
+        return pid;
+    Log(ERR) << "posix_spawn " << path << ": " << strerror(error) << std::endl;
+    close(in[1]);
+    close(out[0]);
+    return -1;
 }
 
-std::vector<char *> createExecArgs(std::string path)
+/**
+ * @brief Reads the value of a Status header: three digits and an optional reason phrase, which
+ * is filled in for the codes we know when it is missing
+ */
+bool parseCGIStatus(const std::string &value, CGIHeaders &h)
 {
-    std::vector<char *> args;
-    args.push_back(strdup(path.c_str()));
-    args.push_back(NULL);
-    return args;
+    if (value.size() < 3 || !std::isdigit(value[0]) || !std::isdigit(value[1]) ||
+        !std::isdigit(value[2]) || (value.size() > 3 && value[3] != ' '))
+        return false;
+    h.statusCode = fromStr<int>(value.substr(0, 3));
+    // an interim response cannot be the script's whole answer
+    if (h.statusCode < 200 || h.statusCode > 599)
+        return false;
+    h.status = value;
+    if (value.size() == 3)
+    {
+        const std::string known = getStatus(h.statusCode);
+        h.status = known.compare(0, 3, value) == 0 ? known : value + " ";
+    }
+    return true;
 }
 
-pid_t startCGIProcess(std::vector<char *> env, int p[2], int &outFd)
+/**
+ * @brief Splits a script's header block into the CGI fields we act on and the header lines sent
+ * to the client. Connection, Keep-Alive and Transfer-Encoding are dropped since the framing of
+ * the response is ours, and a Location without a Status makes the response a 302
+ *
+ * @return false if a line is not a header, or Status or Content-Length is invalid
+ */
+bool parseCGIHeaders(const std::string &block, CGIHeaders &h)
 {
-    if (pipe(p) == -1)
-        return -1;
-    outFd = open(CGI_OUTFILE, O_WRONLY | O_CREAT | O_TRUNC, 0777);
-    if (outFd == -1)
+    std::istringstream lines(block);
+    std::string line;
+    bool hasStatus = false;
+
+    h.statusCode = 200;
+    h.status = getStatus(200);
+    h.hasLength = false;
+    h.contentLength = 0;
+    h.encoded = false;
+    while (std::getline(lines, line))
     {
-        Log(ERR) << "Could not open " << CGI_OUTFILE << " to write" << std::endl;
-        close(p[0]);
-        close(p[1]);
-        return -1;
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (line.empty())
+            continue;
+        const size_t colon = line.find(':');
+        // no field name, or a folded line
+        if (colon == 0 || colon == std::string::npos || line.find_first_of(" \t") < colon)
+            return false;
+        const std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        trimStr(value, " \t");
+        if (strcasecmp(name.c_str(), "Status") == 0)
+        {
+            if (hasStatus || !parseCGIStatus(value, h))
+                return false;
+            hasStatus = true;
+            continue;
+        }
+        if (strcasecmp(name.c_str(), "Content-Length") == 0)
+        {
+            if (h.hasLength || value.empty() || value.size() > 18 ||
+                value.find_first_not_of("0123456789") != std::string::npos)
+                return false;
+            h.hasLength = true;
+            h.contentLength = fromStr<size_t>(value);
+            continue;
+        }
+        if (strcasecmp(name.c_str(), "Connection") == 0 ||
+            strcasecmp(name.c_str(), "Keep-Alive") == 0 ||
+            strcasecmp(name.c_str(), "Transfer-Encoding") == 0)
+            continue;
+        if (strcasecmp(name.c_str(), "Content-Type") == 0)
+            h.contentType = value;
+        else if (strcasecmp(name.c_str(), "Location") == 0)
+            h.location = value;
+        else if (strcasecmp(name.c_str(), "Content-Encoding") == 0)
+            h.encoded = true;
+        h.fields.append(name).append(": ").append(value).append("\r\n");
     }
-    pid_t pid = fork();
-    if (pid == -1)
+    // local redirects (a path instead of a URL) are sent to the client as well
+    if (!h.location.empty() && !hasStatus)
     {
-        close(p[0]);
-        close(p[1]);
-        close(outFd);
-        std::remove(CGI_OUTFILE);
-        std::for_each(env.begin(), env.end(), free);
-        return -1;
+        h.statusCode = 302;
+        h.status = getStatus(302);
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the blank line that ends a CGI header block. Scripts may end their lines with a
+ * bare LF
+ *
+ * @param headerEnd Set to the end of the last header line
+ * @param bodyStart Set to the first byte of the body
+ * @return true if the header block is complete
+ */
+bool findCGIHeaderEnd(const std::string &output, size_t &headerEnd, size_t &bodyStart)
+{
+    for (size_t pos = output.find('\n'); pos != std::string::npos;
+         pos = output.find('\n', pos + 1))
+    {
+        size_t next = pos + 1;
+        if (next < output.size() && output[next] == '\r')
+            next++;
+        if (next < output.size() && output[next] == '\n')
+        {
+            headerEnd = pos;
+            bodyStart = next + 1;
+            return true;
+        }
     }
-    return pid;
+    return false;
 }
@@ -14,6 +14,7 @@
 #include "config/Validators.hpp"
 #include "enums/conversions.hpp"
 #include "utils.hpp"
+#include <algorithm>
 #include <cassert>
 #include <limits>
 #include <sstream>
@@ -28,12 +29,28 @@
 // LOCATION := "location" valid_URL { [LOC_OPTION]... (TRY_FILES | RETURN) [LOC_OPTION]...}
 // TRY_FILES := "try_files" valid_dir ;
 // RETURN := "return" valid_URL ;
-// LOC_OPTION := BODY_SIZE | METHODS | AUTO_INDEX | INDEX | CGI
+// LOC_OPTION := BODY_SIZE | METHODS | AUTO_INDEX | INDEX | CGI | OPEN_FILE_CACHE | COMPRESS_TYPES
+//               | COMPRESS_LEVEL | COMPRESS_MIN_LENGTH | EXPIRES | CACHE_CONTROL | FASTCGI_PASS
+//               | CGI_POOL | CGI_CACHE | CGI_MAX_CONCURRENCY | CGI_QUEUE | CGI_LIMITS
 // BODY_SIZE := "client_max_body_size" positive_number ;
 // METHODS := "limit_except" ("GET" | "POST" | "DELETE" | "PUT" | "HEAD")... ;
 // AUTO_INDEX := "autoindex" ("true" | "false") ;
 // INDEX := "index" filename ;
 // CGI := "cgi_extensions" (.something)... ;
+// OPEN_FILE_CACHE := "open_file_cache" ("off" | "max=" positive_number ["valid=" duration]) ;
+// COMPRESS_TYPES := "compress_types" mime_type... ;
+// COMPRESS_LEVEL := "compress_level" [1 - 9] ;
+// COMPRESS_MIN_LENGTH := "compress_min_length" positive_number ;
+// EXPIRES := "expires" [.extension]... (duration | "off") ;
+// CACHE_CONTROL := "cache_control" [.extension]... directive... ;
+// FASTCGI_PASS := "fastcgi_pass" ("unix:" socket_path | valid_hostname ":" valid_port) ;
+// CGI_POOL := "cgi_pool" executable ["workers=" positive_number] ["requests=" number] ;
+// CGI_CACHE := "cgi_cache" "ttl=" duration ["stale=" (duration | 0)] ["key=" cache_key] ;
+// CGI_MAX_CONCURRENCY := "cgi_max_concurrency" positive_number ;
+// CGI_QUEUE := "cgi_queue" number ;
+// CGI_LIMITS := "cgi_limits" ["cpu=" duration] ["as=" size] ["nofile=" positive_number]
+//               ["nproc=" positive_number] ["cgroup=" path ["cgroup_cpu=" percentage]
+//               ["cgroup_memory=" size]] ;
 
 /**
  * @brief Construct a new Parser object with the config file it will parse
@@ -253,6 +270,18 @@ void Parser::resetLocationBlockAttributes()
     _parsedAttributes.erase(AUTO_INDEX);
     _parsedAttributes.erase(INDEX);
     _parsedAttributes.erase(CGI_EXTENSION);
+    _parsedAttributes.erase(OPEN_FILE_CACHE);
+    _parsedAttributes.erase(COMPRESS_TYPES);
+    _parsedAttributes.erase(COMPRESS_LEVEL);
+    _parsedAttributes.erase(COMPRESS_MIN_LENGTH);
+    _parsedAttributes.erase(EXPIRES);
+    _parsedAttributes.erase(CACHE_CONTROL);
+    _parsedAttributes.erase(FASTCGI_PASS);
+    _parsedAttributes.erase(CGI_POOL);
+    _parsedAttributes.erase(CGI_CACHE);
+    _parsedAttributes.erase(CGI_MAX_CONCURRENCY);
+    _parsedAttributes.erase(CGI_QUEUE);
+    _parsedAttributes.erase(CGI_LIMITS);
 }
 
 /**
@@ -281,7 +310,19 @@ void Parser::parseLocationBlock()
     _currRoute = _currServerBlock->routes.insert(std::make_pair(routePath, Route())).first;
 
     // Set default values
+    _currRoute->second.location = routePath;
     _currRoute->second.bodySize = std::numeric_limits<unsigned int>::max();
+    _currRoute->second.openFileCacheMax = 0;
+    _currRoute->second.openFileCacheValid = DEFAULT_OPEN_FILE_CACHE_VALID;
+    _currRoute->second.compressLevel = DEFAULT_COMPRESS_LEVEL;
+    _currRoute->second.compressMinLength = DEFAULT_COMPRESS_MIN_LENGTH;
+    _currRoute->second.cgiPoolWorkers = DEFAULT_CGI_POOL_WORKERS;
+    _currRoute->second.cgiPoolRequests = DEFAULT_CGI_POOL_REQUESTS;
+    _currRoute->second.cgiCacheTTL = 0;
+    _currRoute->second.cgiCacheStale = DEFAULT_CGI_CACHE_STALE;
+    _currRoute->second.cgiCacheKey = DEFAULT_CGI_CACHE_KEY;
+    _currRoute->second.cgiMaxConcurrency = 0;
+    _currRoute->second.cgiQueue = DEFAULT_CGI_QUEUE;
 
     advanceToken();
     matchToken(LEFT_BRACE, EXPECTED_BLOCK_START("location"));
@@ -310,6 +351,8 @@ void Parser::parseLocationBlock()
         _currRoute->second.methodsAllowed.insert(DELETE);
         _currRoute->second.methodsAllowed.insert(HEAD);
     }
+    resolveCachePolicies();
+    checkOpenFileCache();
     _parsedAttributes.insert(LOCATION);
 }
 
@@ -342,6 +385,42 @@ void Parser::parseLocationOption()
     case CGI_EXTENSION:
         parseCGI();
         break;
+    case OPEN_FILE_CACHE:
+        parseOpenFileCache();
+        break;
+    case COMPRESS_TYPES:
+        parseCompressTypes();
+        break;
+    case COMPRESS_LEVEL:
+        parseCompressLevel();
+        break;
+    case COMPRESS_MIN_LENGTH:
+        parseCompressMinLength();
+        break;
+    case EXPIRES:
+        parseExpires();
+        break;
+    case CACHE_CONTROL:
+        parseCacheControl();
+        break;
+    case FASTCGI_PASS:
+        parseFastCGIPass();
+        break;
+    case CGI_POOL:
+        parseCGIPool();
+        break;
+    case CGI_CACHE:
+        parseCGICache();
+        break;
+    case CGI_MAX_CONCURRENCY:
+        parseCGIMaxConcurrency();
+        break;
+    case CGI_QUEUE:
+        parseCGIQueue();
+        break;
+    case CGI_LIMITS:
+        parseCGILimits();
+        break;
     default:
         throwParseError("unexpected token");
         break;
@@ -514,6 +593,472 @@ void Parser::parseCGI()
     _parsedAttributes.insert(CGI_EXTENSION);
 }
 
+/**
+ * @brief Parse the `open_file_cache` rule
+ */
+void Parser::parseOpenFileCache()
+{
+    // OPEN_FILE_CACHE := "open_file_cache" ("off" | "max=" positive_number ["valid=" duration])
+    // SEMICOLON
+    assertThat(_parsedAttributes.count(OPEN_FILE_CACHE) == 0, DUPLICATE("open_file_cache"));
+
+    advanceToken();
+    matchToken(WORD, INVALID("`off` or `max=N`"));
+
+    Route &route = _currRoute->second;
+    if (_currToken->contents() == "off")
+    {
+        advanceToken();
+        matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+        _parsedAttributes.insert(OPEN_FILE_CACHE);
+        return;
+    }
+    while (!atEnd() && currentToken() == WORD)
+    {
+        const std::string &option = _currToken->contents();
+        if (option.compare(0, 4, "max=") == 0)
+        {
+            assertThat(validatePositiveNumber(option.substr(4)), INVALID("max number of files"));
+            route.openFileCacheMax = fromStr<size_t>(option.substr(4));
+        }
+        else if (option.compare(0, 6, "valid=") == 0)
+        {
+            assertThat(validateDuration(option.substr(6)), INVALID("duration. e.g. 30s"));
+            route.openFileCacheValid = durationToSeconds(option.substr(6));
+        }
+        else
+            throwParseError(INVALID("`open_file_cache` option"));
+        advanceToken();
+    }
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+    assertThat(route.openFileCacheMax != 0, "`open_file_cache` requires a `max=` option");
+
+    _parsedAttributes.insert(OPEN_FILE_CACHE);
+}
+
+/**
+ * @brief Locations serving the same directory share one open file cache, so they must not ask
+ * for different sizes or validity periods
+ */
+void Parser::checkOpenFileCache() const
+{
+    const Route &route = _currRoute->second;
+
+    if (route.openFileCacheMax == 0)
+        return;
+    for (std::vector<ServerBlock>::const_iterator block = _serverConfig.begin();
+         block != _serverConfig.end(); block++)
+        for (std::map<std::string, Route>::const_iterator it = block->routes.begin();
+             it != block->routes.end(); it++)
+        {
+            const Route &other = it->second;
+            if (&other == &route || other.openFileCacheMax == 0 || other.serveDir != route.serveDir)
+                continue;
+            assertThat(other.openFileCacheMax == route.openFileCacheMax &&
+                           other.openFileCacheValid == route.openFileCacheValid,
+                       "`open_file_cache` differs from another location serving the same "
+                       "directory");
+        }
+}
+
+/**
+ * @brief Parse the `compress_types` rule. Compression is enabled on routes that have it
+ */
+void Parser::parseCompressTypes()
+{
+    // COMPRESS_TYPES := "compress_types" mime_type... SEMICOLON
+    assertThat(_parsedAttributes.count(COMPRESS_TYPES) == 0, DUPLICATE("compress_types"));
+
+    advanceToken();
+    matchToken(WORD, INVALID("MIME type"));
+
+    std::set<std::string> &types = _currRoute->second.compressTypes;
+    while (!atEnd() && currentToken() == WORD)
+    {
+        std::string type = _currToken->contents();
+        assertThat(validateMimeType(type), INVALID("MIME type. e.g. text/html"));
+        std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+        assertThat(types.count(type) == 0, "duplicate MIME type specified");
+        types.insert(type);
+        advanceToken();
+    }
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+
+    _parsedAttributes.insert(COMPRESS_TYPES);
+}
+
+/**
+ * @brief Parse the `compress_level` rule
+ */
+void Parser::parseCompressLevel()
+{
+    // COMPRESS_LEVEL := "compress_level" [1 - 9] SEMICOLON
+    assertThat(_parsedAttributes.count(COMPRESS_LEVEL) == 0, DUPLICATE("compress_level"));
+
+    advanceToken();
+    matchToken(WORD, INVALID("compression level [1 - 9]"));
+
+    const std::string &level = _currToken->contents();
+    assertThat(validatePositiveNumber(level) && fromStr<int>(level) <= MAX_COMPRESS_LEVEL,
+               INVALID("compression level [1 - 9]"));
+    _currRoute->second.compressLevel = fromStr<int>(level);
+
+    advanceToken();
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+
+    _parsedAttributes.insert(COMPRESS_LEVEL);
+}
+
+/**
+ * @brief Parse the `compress_min_length` rule
+ */
+void Parser::parseCompressMinLength()
+{
+    // COMPRESS_MIN_LENGTH := "compress_min_length" positive_number SEMICOLON
+    assertThat(_parsedAttributes.count(COMPRESS_MIN_LENGTH) == 0,
+               DUPLICATE("compress_min_length"));
+
+    advanceToken();
+    matchToken(WORD, INVALID("length"));
+
+    assertThat(validatePositiveNumber(_currToken->contents()), INVALID("length"));
+    _currRoute->second.compressMinLength = fromStr<size_t>(_currToken->contents());
+
+    advanceToken();
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+
+    _parsedAttributes.insert(COMPRESS_MIN_LENGTH);
+}
+
+/**
+ * @brief Parse the file extensions a caching rule is limited to, if any
+ *
+ * @return std::vector<std::string> The extensions, or only "" if the rule is for all files
+ */
+std::vector<std::string> Parser::parseCacheExtensions()
+{
+    std::vector<std::string> extensions;
+
+    while (!atEnd() && currentToken() == WORD && _currToken->contents()[0] == '.')
+    {
+        std::string extension = _currToken->contents();
+        assertThat(extension.length() >= 2, INVALID("file extension"));
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        extensions.push_back(extension);
+        advanceToken();
+    }
+    if (extensions.empty())
+        extensions.push_back("");
+    return extensions;
+}
+
+/**
+ * @brief Parse the `expires` rule. Can be given once for all files and once per extension
+ */
+void Parser::parseExpires()
+{
+    // EXPIRES := "expires" [.extension]... (duration | "off") SEMICOLON
+    advanceToken();
+    const std::vector<std::string> &extensions = parseCacheExtensions();
+    matchToken(WORD, INVALID("duration. e.g. 30d"));
+
+    const std::string &value = _currToken->contents();
+    long expires = EXPIRES_OFF;
+    if (value != "off")
+    {
+        assertThat(validateDuration(value), INVALID("duration. e.g. 30d"));
+        expires = durationToSeconds(value);
+    }
+    for (size_t i = 0; i < extensions.size(); i++)
+    {
+        CachePolicy &policy = _currRoute->second.cachePolicies[extensions[i]];
+        assertThat(policy.expires == EXPIRES_UNSET, DUPLICATE("expires"));
+        policy.expires = expires;
+    }
+
+    advanceToken();
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+
+    _parsedAttributes.insert(EXPIRES);
+}
+
+/**
+ * @brief Parse the `cache_control` rule. Can be given once for all files and once per extension
+ */
+void Parser::parseCacheControl()
+{
+    // CACHE_CONTROL := "cache_control" [.extension]... directive... SEMICOLON
+    advanceToken();
+    const std::vector<std::string> &extensions = parseCacheExtensions();
+    matchToken(WORD, INVALID("Cache-Control directive. e.g. public"));
+
+    std::string value;
+    while (!atEnd() && currentToken() == WORD)
+    {
+        value += (value.empty() ? "" : " ") + _currToken->contents();
+        advanceToken();
+    }
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+    for (size_t i = 0; i < extensions.size(); i++)
+    {
+        CachePolicy &policy = _currRoute->second.cachePolicies[extensions[i]];
+        assertThat(policy.cacheControl.empty(), DUPLICATE("cache_control"));
+        policy.cacheControl = value;
+    }
+
+    _parsedAttributes.insert(CACHE_CONTROL);
+}
+
+/**
+ * @brief Parse the `fastcgi_pass` rule
+ */
+void Parser::parseFastCGIPass()
+{
+    // FASTCGI_PASS := "fastcgi_pass" ("unix:" socket_path | valid_hostname ":" valid_port)
+    // SEMICOLON
+    assertThat(_parsedAttributes.count(FASTCGI_PASS) == 0, DUPLICATE("fastcgi_pass"));
+    assertThat(_parsedAttributes.count(CGI_POOL) == 0,
+               "`fastcgi_pass` can not be used with `cgi_pool`");
+
+    advanceToken();
+    matchToken(WORD, INVALID("FastCGI address"));
+
+    assertThat(validateUpstream(_currToken->contents()), INVALID("FastCGI address"));
+    _currRoute->second.fastcgiPass = _currToken->contents();
+
+    advanceToken();
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+
+    _parsedAttributes.insert(FASTCGI_PASS);
+}
+
+/**
+ * @brief Parse the `cgi_pool` rule. The CGI files are handled by workers started from the given
+ * program, which speak FastCGI on their stdin and stdout
+ */
+void Parser::parseCGIPool()
+{
+    // CGI_POOL := "cgi_pool" executable ["workers=" positive_number] ["requests=" number]
+    // SEMICOLON
+    assertThat(_parsedAttributes.count(CGI_POOL) == 0, DUPLICATE("cgi_pool"));
+    assertThat(_parsedAttributes.count(FASTCGI_PASS) == 0,
+               "`cgi_pool` can not be used with `fastcgi_pass`");
+
+    advanceToken();
+    matchToken(WORD, INVALID("worker program"));
+
+    Route &route = _currRoute->second;
+    assertThat(validateExecutable(_currToken->contents()), INVALID("worker program"));
+    route.cgiPool = _currToken->contents();
+
+    advanceToken();
+    while (!atEnd() && currentToken() == WORD)
+    {
+        const std::string &option = _currToken->contents();
+        if (option.compare(0, 8, "workers=") == 0)
+        {
+            assertThat(validatePositiveNumber(option.substr(8)), INVALID("number of workers"));
+            route.cgiPoolWorkers = fromStr<size_t>(option.substr(8));
+        }
+        else if (option.compare(0, 9, "requests=") == 0)
+        {
+            // 0 keeps every worker for as long as it runs
+            assertThat(option.substr(9) == "0" || validatePositiveNumber(option.substr(9)),
+                       INVALID("number of requests"));
+            route.cgiPoolRequests = fromStr<size_t>(option.substr(9));
+        }
+        else
+            throwParseError(INVALID("`cgi_pool` option"));
+        advanceToken();
+    }
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+
+    _parsedAttributes.insert(CGI_POOL);
+}
+
+/**
+ * @brief Parse the `cgi_cache` rule. Responses of GET requests to the CGI files are kept for
+ * `ttl=` and served stale for `stale=` more while they are regenerated
+ */
+void Parser::parseCGICache()
+{
+    // CGI_CACHE := "cgi_cache" "ttl=" duration ["stale=" (duration | 0)] ["key=" cache_key]
+    // SEMICOLON
+    assertThat(_parsedAttributes.count(CGI_CACHE) == 0, DUPLICATE("cgi_cache"));
+
+    advanceToken();
+    matchToken(WORD, INVALID("`ttl=` option"));
+
+    Route &route = _currRoute->second;
+    while (!atEnd() && currentToken() == WORD)
+    {
+        const std::string &option = _currToken->contents();
+        if (option.compare(0, 4, "ttl=") == 0)
+        {
+            assertThat(validateDuration(option.substr(4)), INVALID("duration. e.g. 5s"));
+            route.cgiCacheTTL = durationToSeconds(option.substr(4));
+        }
+        else if (option.compare(0, 6, "stale=") == 0)
+        {
+            assertThat(option.substr(6) == "0" || validateDuration(option.substr(6)),
+                       INVALID("duration. e.g. 30s"));
+            route.cgiCacheStale = durationToSeconds(option.substr(6));
+        }
+        else if (option.compare(0, 4, "key=") == 0)
+        {
+            assertThat(validateCacheKey(option.substr(4)), INVALID("cache key"));
+            route.cgiCacheKey = option.substr(4);
+        }
+        else
+            throwParseError(INVALID("`cgi_cache` option"));
+        advanceToken();
+    }
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+    assertThat(route.cgiCacheTTL != 0, "`cgi_cache` requires a `ttl=` option");
+
+    _parsedAttributes.insert(CGI_CACHE);
+}
+
+/**
+ * @brief Parse the `cgi_max_concurrency` rule
+ */
+void Parser::parseCGIMaxConcurrency()
+{
+    // CGI_MAX_CONCURRENCY := "cgi_max_concurrency" positive_number SEMICOLON
+    assertThat(_parsedAttributes.count(CGI_MAX_CONCURRENCY) == 0,
+               DUPLICATE("cgi_max_concurrency"));
+
+    advanceToken();
+    matchToken(WORD, INVALID("number of CGI requests"));
+
+    assertThat(validatePositiveNumber(_currToken->contents()), INVALID("number of CGI requests"));
+    _currRoute->second.cgiMaxConcurrency = fromStr<size_t>(_currToken->contents());
+
+    advanceToken();
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+
+    _parsedAttributes.insert(CGI_MAX_CONCURRENCY);
+}
+
+/**
+ * @brief Parse the `cgi_queue` rule, 0 answers requests over the concurrency limit with a 503
+ * right away
+ */
+void Parser::parseCGIQueue()
+{
+    // CGI_QUEUE := "cgi_queue" number SEMICOLON
+    assertThat(_parsedAttributes.count(CGI_QUEUE) == 0, DUPLICATE("cgi_queue"));
+
+    advanceToken();
+    matchToken(WORD, INVALID("queue length"));
+
+    const std::string &length = _currToken->contents();
+    assertThat(length == "0" || validatePositiveNumber(length), INVALID("queue length"));
+    _currRoute->second.cgiQueue = fromStr<size_t>(length);
+
+    advanceToken();
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+
+    _parsedAttributes.insert(CGI_QUEUE);
+}
+
+/**
+ * @brief Parse the `cgi_limits` rule
+ */
+void Parser::parseCGILimits()
+{
+    // CGI_LIMITS := "cgi_limits" ["cpu=" duration] ["as=" size] ["nofile=" positive_number]
+    // ["nproc=" positive_number] ["cgroup=" path ["cgroup_cpu=" percentage]
+    // ["cgroup_memory=" size]] SEMICOLON
+    assertThat(_parsedAttributes.count(CGI_LIMITS) == 0, DUPLICATE("cgi_limits"));
+
+    advanceToken();
+    matchToken(WORD, INVALID("`cgi_limits` option"));
+
+    CGILimits &limits = _currRoute->second.cgiLimits;
+    while (!atEnd() && currentToken() == WORD)
+    {
+        const std::string &option = _currToken->contents();
+        const std::string value = option.substr(option.find('=') + 1);
+        if (option.compare(0, 4, "cpu=") == 0)
+        {
+            assertThat(validateDuration(value), INVALID("CPU time. e.g. 30s"));
+            limits.cpu = durationToSeconds(value);
+        }
+        else if (option.compare(0, 3, "as=") == 0)
+        {
+            assertThat(validateSize(value), INVALID("size. e.g. 512M"));
+            limits.addressSpace = sizeToBytes(value);
+        }
+        else if (option.compare(0, 7, "nofile=") == 0)
+        {
+            assertThat(validatePositiveNumber(value), INVALID("number of open files"));
+            limits.openFiles = fromStr<size_t>(value);
+        }
+        else if (option.compare(0, 6, "nproc=") == 0)
+        {
+            assertThat(validatePositiveNumber(value), INVALID("number of processes"));
+            limits.processes = fromStr<size_t>(value);
+        }
+        else if (option.compare(0, 7, "cgroup=") == 0)
+        {
+            assertThat(value.size() > 1 && value[0] == '/', INVALID("cgroup path"));
+            limits.cgroup = value;
+            rightTrimStr(limits.cgroup, "/");
+        }
+        else if (option.compare(0, 11, "cgroup_cpu=") == 0)
+        {
+            assertThat(value.size() > 1 && *value.rbegin() == '%' &&
+                           validatePositiveNumber(value.substr(0, value.size() - 1)),
+                       INVALID("CPU percentage. e.g. 50%"));
+            limits.cgroupCPU = fromStr<unsigned int>(value.substr(0, value.size() - 1));
+        }
+        else if (option.compare(0, 14, "cgroup_memory=") == 0)
+        {
+            assertThat(validateSize(value), INVALID("size. e.g. 256M"));
+            limits.cgroupMemory = sizeToBytes(value);
+        }
+        else
+            throwParseError(INVALID("`cgi_limits` option"));
+        advanceToken();
+    }
+    matchToken(SEMICOLON, EXPECTED_SEMICOLON);
+    assertThat(!limits.cgroup.empty() || (limits.cgroupCPU == 0 && limits.cgroupMemory == 0),
+               "`cgroup_cpu` and `cgroup_memory` require a `cgroup=` option");
+
+    _parsedAttributes.insert(CGI_LIMITS);
+}
+
+/**
+ * @brief Once a location block is parsed, extension policies inherit what they do not set from
+ * the policy for all files, and every Cache-Control line is formatted
+ */
+void Parser::resolveCachePolicies()
+{
+    std::map<std::string, CachePolicy> &policies = _currRoute->second.cachePolicies;
+
+    if (policies.empty())
+        return;
+    const CachePolicy defaults = policies[""];
+    for (std::map<std::string, CachePolicy>::iterator it = policies.begin(); it != policies.end();
+         it++)
+    {
+        CachePolicy &policy = it->second;
+        if (policy.expires == EXPIRES_UNSET)
+            policy.expires = defaults.expires;
+        if (policy.cacheControl.empty())
+            policy.cacheControl = defaults.cacheControl;
+
+        std::string value;
+        if (policy.expires >= 0)
+            value = "max-age=" + toStr(policy.expires);
+        if (!policy.cacheControl.empty())
+            value += (value.empty() ? "" : ", ") + policy.cacheControl;
+        if (!value.empty())
+            policy.header = "Cache-Control: " + value + "\r\n";
+    }
+}
+
 /**
  * @brief Will check the current token and determine if it is a `server` option
  *
@@ -553,6 +1098,18 @@ bool Parser::atLocationOption() const
     case CGI_EXTENSION:
     case RETURN:
     case INDEX:
+    case OPEN_FILE_CACHE:
+    case COMPRESS_TYPES:
+    case COMPRESS_LEVEL:
+    case COMPRESS_MIN_LENGTH:
+    case EXPIRES:
+    case CACHE_CONTROL:
+    case FASTCGI_PASS:
+    case CGI_POOL:
+    case CGI_CACHE:
+    case CGI_MAX_CONCURRENCY:
+    case CGI_QUEUE:
+    case CGI_LIMITS:
         return true;
     default:
         return false;
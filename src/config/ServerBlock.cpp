@@ -20,9 +20,20 @@
  *
  * @return Route Default route
  */
+CachePolicy::CachePolicy() : expires(EXPIRES_UNSET), cacheControl(), header()
+{
+}
+
+CGILimits::CGILimits()
+    : cpu(0), addressSpace(0), openFiles(0), processes(0), cgroup(), cgroupCPU(0),
+      cgroupMemory(0)
+{
+}
+
 static Route createDefaultRoute()
 {
     Route defaultRoute;
+    defaultRoute.location = "/";
     defaultRoute.serveDir = "./assets";
 
     // Max body size is ~4GB by default
@@ -38,6 +49,27 @@ static Route createDefaultRoute()
     defaultRoute.methodsAllowed.insert(PUT);
     defaultRoute.methodsAllowed.insert(DELETE);
     defaultRoute.methodsAllowed.insert(HEAD);
+
+    // Open file caching is off by default
+    defaultRoute.openFileCacheMax = 0;
+    defaultRoute.openFileCacheValid = DEFAULT_OPEN_FILE_CACHE_VALID;
+
+    // Compression is off by default
+    defaultRoute.compressLevel = DEFAULT_COMPRESS_LEVEL;
+    defaultRoute.compressMinLength = DEFAULT_COMPRESS_MIN_LENGTH;
+
+    // CGI files are run with a fork by default
+    defaultRoute.cgiPoolWorkers = DEFAULT_CGI_POOL_WORKERS;
+    defaultRoute.cgiPoolRequests = DEFAULT_CGI_POOL_REQUESTS;
+
+    // CGI responses are not cached by default
+    defaultRoute.cgiCacheTTL = 0;
+    defaultRoute.cgiCacheStale = DEFAULT_CGI_CACHE_STALE;
+    defaultRoute.cgiCacheKey = DEFAULT_CGI_CACHE_KEY;
+
+    // CGI requests all start at once by default
+    defaultRoute.cgiMaxConcurrency = 0;
+    defaultRoute.cgiQueue = DEFAULT_CGI_QUEUE;
     return defaultRoute;
 }
 
@@ -78,6 +110,49 @@ static void printRoute(std::string &str, const std::pair<std::string, Route> &ro
     route.second.autoIndex ? str += "yes\n" : str += "no\n";
     "\t\tIndex file: " + route.second.indexFile + "\n";
     str += "\t\tMax body size: " + toStr(route.second.bodySize) + "\n";
+    if (route.second.openFileCacheMax != 0)
+        str += "\t\tOpen file cache: max=" + toStr(route.second.openFileCacheMax) +
+               " valid=" + toStr(route.second.openFileCacheValid) + "s\n";
+    if (!route.second.compressTypes.empty())
+    {
+        str += "\t\tCompress: level=" + toStr(route.second.compressLevel) +
+               " min_length=" + toStr(route.second.compressMinLength) + " types=";
+        for (std::set<std::string>::const_iterator it = route.second.compressTypes.begin();
+             it != route.second.compressTypes.end(); it++)
+            str += *it + " ";
+        str += "\n";
+    }
+    for (std::map<std::string, CachePolicy>::const_iterator it =
+             route.second.cachePolicies.begin();
+         it != route.second.cachePolicies.end(); it++)
+    {
+        str += "\t\tCache policy" + (it->first.empty() ? "" : " for " + it->first) + ": ";
+        if (it->second.expires >= 0)
+            str += "expires=" + toStr(it->second.expires) + "s ";
+        if (it->second.header.empty())
+            str += "no Cache-Control\n";
+        else   // without the CRLF
+            str += it->second.header.substr(0, it->second.header.length() - 2) + "\n";
+    }
+    if (!route.second.fastcgiPass.empty())
+        str += "\t\tFastCGI app: " + route.second.fastcgiPass + "\n";
+    if (!route.second.cgiPool.empty())
+        str += "\t\tCGI pool: " + route.second.cgiPool +
+               " workers=" + toStr(route.second.cgiPoolWorkers) +
+               " requests=" + toStr(route.second.cgiPoolRequests) + "\n";
+    if (route.second.cgiCacheTTL != 0)
+        str += "\t\tCGI cache: ttl=" + toStr(route.second.cgiCacheTTL) +
+               "s stale=" + toStr(route.second.cgiCacheStale) +
+               "s key=" + route.second.cgiCacheKey + "\n";
+    if (route.second.cgiMaxConcurrency != 0)
+        str += "\t\tCGI concurrency: " + toStr(route.second.cgiMaxConcurrency) + ", queue " +
+               toStr(route.second.cgiQueue) + "\n";
+    const CGILimits &limits = route.second.cgiLimits;
+    if (limits.cpu != 0 || limits.addressSpace != 0 || limits.openFiles != 0 ||
+        limits.processes != 0 || !limits.cgroup.empty())
+        str += "\t\tCGI limits: cpu=" + toStr(limits.cpu) + "s as=" + toStr(limits.addressSpace) +
+               " nofile=" + toStr(limits.openFiles) + " nproc=" + toStr(limits.processes) +
+               (limits.cgroup.empty() ? "" : " cgroup=" + limits.cgroup) + "\n";
     str += "\t\tMethods allowed: ";
     for (std::set<HTTPMethod>::const_iterator it = route.second.methodsAllowed.begin();
          it != route.second.methodsAllowed.end(); it++)
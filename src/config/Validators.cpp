@@ -18,6 +18,7 @@
 #include <map>
 #include <sstream>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
 /**
@@ -227,6 +228,70 @@ bool validateBodySize(const std::string &bodySizeStr)
     return bodySize >= 10 && bodySize <= std::numeric_limits<unsigned int>::max();
 }
 
+/**
+ * @brief Checks if the string is a number greater than zero that fits in an unsigned int
+ *
+ * @param numStr Number as a string
+ * @return true if the number is valid
+ */
+bool validatePositiveNumber(const std::string &numStr)
+{
+    std::stringstream numStream(numStr);
+    size_t num = 0;
+
+    // Reject signs and whitespace that the stream would otherwise accept
+    if (numStr.empty() || !std::isdigit(numStr[0]))
+        return false;
+
+    numStream >> num;
+
+    // Checks if the conversion failed or if there are additional characters
+    if (!numStream || !numStream.eof())
+        return false;
+
+    return num >= 1 && num <= std::numeric_limits<unsigned int>::max();
+}
+
+/**
+ * @brief Checks if a duration is valid. A duration is a positive number optionally followed by
+ * one of the units `s`, `m`, `h` or `d`. For example: 30s, 5m, 30d
+ *
+ * @param durationStr Duration to validate
+ * @return true if the duration is valid
+ */
+bool validateDuration(const std::string &durationStr)
+{
+    if (durationStr.empty())
+        return false;
+
+    std::string numStr(durationStr);
+    if (std::string("smhd").find(*numStr.rbegin()) != std::string::npos)
+        numStr.erase(numStr.length() - 1);
+
+    // Durations longer than ~68 years can't be represented
+    return validatePositiveNumber(numStr) &&
+           durationToSeconds(durationStr) <= static_cast<size_t>(std::numeric_limits<int>::max());
+}
+
+/**
+ * @brief Checks if a size is valid. A size is a positive number optionally followed by one of the
+ * units `k`, `m` or `g`, in either case. For example: 4096, 512k, 256M
+ *
+ * @param sizeStr Size to validate
+ * @return true if the size is valid
+ */
+bool validateSize(const std::string &sizeStr)
+{
+    if (sizeStr.empty())
+        return false;
+
+    std::string numStr(sizeStr);
+    if (std::string("kKmMgG").find(*numStr.rbegin()) != std::string::npos)
+        numStr.erase(numStr.length() - 1);
+
+    return validatePositiveNumber(numStr);
+}
+
 /**
  * @brief Checks if a port is valid
  *
@@ -259,3 +324,84 @@ bool validateURL(const std::string &urlStr)
 {
     return !urlStr.empty();
 }
+
+/**
+ * @brief Checks if a MIME type is valid. A MIME type is a type and a subtype separated by a `/`,
+ * for example: text/html, application/javascript
+ *
+ * @param mimeType MIME type to validate
+ * @return true if the MIME type is valid
+ */
+bool validateMimeType(const std::string &mimeType)
+{
+    const std::string tokenChars("!#$&-^_.+");
+    size_t slash = mimeType.find('/');
+
+    if (slash == 0 || slash == std::string::npos || slash == mimeType.length() - 1 ||
+        mimeType.find('/', slash + 1) != std::string::npos)
+        return false;
+    for (size_t i = 0; i < mimeType.length(); i++)
+        if (i != slash && !std::isalnum(mimeType[i]) &&
+            tokenChars.find(mimeType[i]) == std::string::npos)
+            return false;
+    return true;
+}
+
+/**
+ * @brief Checks if an upstream address is valid: `unix:` followed by a socket path, or a hostname
+ * and a port separated by a `:`, for example: unix:/run/php-fpm.sock, 127.0.0.1:9000
+ *
+ * @param address Address to validate
+ * @return true if the address is valid
+ */
+bool validateUpstream(const std::string &address)
+{
+    if (address.compare(0, 5, "unix:") == 0)
+        return address.length() > 5;
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+    return validateHostName(address.substr(0, colon)) && validatePort(address.substr(colon + 1));
+}
+
+/**
+ * @brief Checks if a path is a regular file the server can execute
+ *
+ * @param path Path to validate
+ * @return true if the file exists and is executable
+ */
+bool validateExecutable(const std::string &path)
+{
+    struct stat info;
+
+    if (path.empty() || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+        return false;
+    return access(path.c_str(), X_OK) == 0;
+}
+
+/**
+ * @brief Checks if a cgi_cache key is valid. It is made of text and the variables $host, $uri,
+ * $args, $request_uri and $http_ followed by a header name
+ *
+ * @param key Key to validate
+ * @return true if every variable in the key is known
+ */
+bool validateCacheKey(const std::string &key)
+{
+    static const char *variables[] = {"host", "uri", "args", "request_uri"};
+
+    if (key.empty())
+        return false;
+    for (size_t pos = key.find('$'); pos != std::string::npos; pos = key.find('$', pos))
+    {
+        size_t end = ++pos;
+        while (end < key.size() && (std::isalnum(key[end]) || key[end] == '_'))
+            end++;
+        const std::string name = key.substr(pos, end - pos);
+        if (name.compare(0, 5, "http_") == 0 && name.size() > 5)
+            continue;
+        if (std::find(variables, variables + 4, name) == variables + 4)
+            return false;
+    }
+    return true;
+}
@@ -115,6 +115,30 @@ template <> std::string enumToStr(const TokenType &enumVal)
         return "CGI_EXTENSION";
     case RETURN:
         return "RETURN";
+    case OPEN_FILE_CACHE:
+        return "OPEN_FILE_CACHE";
+    case COMPRESS_TYPES:
+        return "COMPRESS_TYPES";
+    case COMPRESS_LEVEL:
+        return "COMPRESS_LEVEL";
+    case COMPRESS_MIN_LENGTH:
+        return "COMPRESS_MIN_LENGTH";
+    case EXPIRES:
+        return "EXPIRES";
+    case CACHE_CONTROL:
+        return "CACHE_CONTROL";
+    case FASTCGI_PASS:
+        return "FASTCGI_PASS";
+    case CGI_POOL:
+        return "CGI_POOL";
+    case CGI_CACHE:
+        return "CGI_CACHE";
+    case CGI_MAX_CONCURRENCY:
+        return "CGI_MAX_CONCURRENCY";
+    case CGI_QUEUE:
+        return "CGI_QUEUE";
+    case CGI_LIMITS:
+        return "CGI_LIMITS";
     }
 }
 
@@ -180,7 +204,19 @@ template <> TokenType strToEnum<TokenType>(const std::string &str)
                                              "autoindex",
                                              "index",
                                              "cgi_extensions",
-                                             "return"};
+                                             "return",
+                                             "open_file_cache",
+                                             "compress_types",
+                                             "compress_level",
+                                             "compress_min_length",
+                                             "expires",
+                                             "cache_control",
+                                             "fastcgi_pass",
+                                             "cgi_pool",
+                                             "cgi_cache",
+                                             "cgi_max_concurrency",
+                                             "cgi_queue",
+                                             "cgi_limits"};
 
     for (size_t i = 0; i < sizeOfArray(tokenTypes); i++)
         if (tokenTypes[i] == str)
@@ -8,6 +8,7 @@
  *
  */
 
+#include "cgiUtils.hpp"
 #include "config/Parser.hpp"
 #include "config/ServerBlock.hpp"
 #include "config/Validators.hpp"
@@ -26,6 +27,9 @@
  */
 int main(int argc, char **argv)
 {
+    // started by ourselves to apply the resource limits of a CGI script before running it
+    if (getenv(CGI_LIMITS_ENV) != NULL)
+        return execWithCGILimits(argv);
     if (argc > 2)
     {
         std::cerr << "" << std::endl;
@@ -38,6 +42,7 @@ int main(int argc, char **argv)
     // requestParsingTests();
     // generateDirectoryListing(".");
     // chunkerTests();
+    // responseTests();
     try
     {
         if (argc == 2)
@@ -117,19 +117,19 @@ void Connection::processGET()
         _response.createRedirectResponse(resource.path, 302, _keepAlive);
         break;
     case FORBIDDEN_METHOD:
-        _response.createHTMLResponse(405, errorPage(405, resource), _keepAlive);
+        _response.createErrorResponse(405, resource, _keepAlive);
         break;
     case DIRECTORY:
-        _response.createHTMLResponse(200, directoryListing(resource), _keepAlive);
+        _response.createListingResponse(_request);
         break;
     case NOT_FOUND:
-        _response.createHTMLResponse(404, errorPage(404, resource), _keepAlive);
+        _response.createErrorResponse(404, resource, _keepAlive);
         break;
     case INVALID_REQUEST:
-        _response.createHTMLResponse(400, errorPage(400, resource), _keepAlive);
+        _response.createErrorResponse(400, resource, _keepAlive);
         break;
     case NO_MATCH:
-        _response.createHTMLResponse(404, errorPage(404, resource), _keepAlive);
+        _response.createErrorResponse(404, resource, _keepAlive);
         break;
     case CGI:
         _response.createCGIResponse(_request, prepCGIEnvironment());
@@ -144,26 +144,26 @@ void Connection::processPOST()
     switch (resource.type)
     {
     case EXISTING_FILE:
-        _response.createHTMLResponse(409, errorPage(409, resource), _keepAlive);
+        _response.createErrorResponse(409, resource, _keepAlive);
         break;
     case REDIRECTION:
         _response.createRedirectResponse(resource.path, 307, _keepAlive);
         break;
     case FORBIDDEN_METHOD:
-        _response.createHTMLResponse(405, errorPage(405, resource), _keepAlive);
+        _response.createErrorResponse(405, resource, _keepAlive);
         break;
     case DIRECTORY:
         _response.createFileResponse(_request, 201);
-        // _response.createHTMLResponse(405, errorPage(405, resource), _keepAlive);
+        // _response.createErrorResponse(405, resource, _keepAlive);
         break;
     case NOT_FOUND:
         _response.createFileResponse(_request, 201);
         break;
     case INVALID_REQUEST:
-        _response.createHTMLResponse(400, errorPage(400, resource), _keepAlive);
+        _response.createErrorResponse(400, resource, _keepAlive);
         break;
     case NO_MATCH:
-        _response.createHTMLResponse(404, errorPage(404, resource), _keepAlive);
+        _response.createErrorResponse(404, resource, _keepAlive);
         break;
     case CGI:
         _response.createCGIResponse(_request, prepCGIEnvironment());
@@ -184,20 +184,20 @@ void Connection::processPUT()
         _response.createRedirectResponse(resource.path, 307, _keepAlive);
         break;
     case FORBIDDEN_METHOD:
-        _response.createHTMLResponse(405, errorPage(405, resource), _keepAlive);
+        _response.createErrorResponse(405, resource, _keepAlive);
         break;
     case DIRECTORY:
         _response.createFileResponse(_request, 201);
-        // _response.createHTMLResponse(405, errorPage(405, resource), _keepAlive);
+        // _response.createErrorResponse(405, resource, _keepAlive);
         break;
     case NOT_FOUND:
         _response.createFileResponse(_request, 201);
         break;
     case INVALID_REQUEST:
-        _response.createHTMLResponse(400, errorPage(400, resource), _keepAlive);
+        _response.createErrorResponse(400, resource, _keepAlive);
         break;
     case NO_MATCH:
-        _response.createHTMLResponse(404, errorPage(404, resource), _keepAlive);
+        _response.createErrorResponse(404, resource, _keepAlive);
         break;
     case CGI:
         _response.createFileResponse(_request, 204);
@@ -218,19 +218,19 @@ void Connection::processDELETE()
         _response.createRedirectResponse(resource.path, 307, _keepAlive);
         break;
     case FORBIDDEN_METHOD:
-        _response.createHTMLResponse(405, errorPage(405, resource), _keepAlive);
+        _response.createErrorResponse(405, resource, _keepAlive);
         break;
     case DIRECTORY:
-        _response.createHTMLResponse(405, errorPage(405, resource), _keepAlive);
+        _response.createErrorResponse(405, resource, _keepAlive);
         break;
     case NOT_FOUND:
-        _response.createHTMLResponse(404, errorPage(404, resource), _keepAlive);
+        _response.createErrorResponse(404, resource, _keepAlive);
         break;
     case INVALID_REQUEST:
-        _response.createHTMLResponse(400, errorPage(400, resource), _keepAlive);
+        _response.createErrorResponse(400, resource, _keepAlive);
         break;
     case NO_MATCH:
-        _response.createHTMLResponse(404, errorPage(404, resource), _keepAlive);
+        _response.createErrorResponse(404, resource, _keepAlive);
         break;
     case CGI:
         _response.createDELETEResponse(_request);
@@ -266,8 +266,8 @@ void Connection::processHEAD()
         _response.createHEADResponse(404, NO_CONTENT, _keepAlive);
         break;
     case CGI:
+        // the body is trimmed once the script has exited
         _response.createCGIResponse(_request, prepCGIEnvironment());
-        _response.trimBody();
         break;
     }
 }
@@ -278,6 +278,7 @@ void Connection::processRequest()
         return;
     _keepAlive = _request.keepAlive();
     _timeOut = _request.keepAliveTimer();
+    _response.negotiateCompression(_request);
     if (bodySizeExceeded())
         return;
     switch (_request.method())
@@ -298,7 +299,7 @@ void Connection::processRequest()
         processHEAD();
         break;
     case OTHER:
-        _response.createHTMLResponse(400, errorPage(400, _request.resource()), _keepAlive);
+        _response.createErrorResponse(400, _request.resource(), _keepAlive);
         break;
     }
     _request.clear();
@@ -313,6 +314,56 @@ bool Connection::keepConnectionAlive()
     return true;
 }
 
+/**
+ * @brief Events to poll the socket for. POLLOUT is only asked for when there is something to
+ * send, so connections waiting for a request or for a CGI script do not wake up the event loop.
+ * POLLRDHUP tells a client that left while its CGI request runs, even if reading is paused
+ */
+short Connection::pollEvents()
+{
+    // reading pauses while a CGI script is behind on the body it is being sent
+    short events = _response.cgiInputFull() ? 0 : POLLIN;
+
+    if (_response.runningCGI())
+        events |= POLLRDHUP;
+    if (_dropped || (_reqReady && (_request.length() != 0 || _response.hasOutput())))
+        events |= POLLOUT;
+    return events;
+}
+
+/**
+ * @brief Starts the CGI script of a request as soon as its headers are in, so the script reads the
+ * body while it is still being uploaded instead of after it has been buffered whole. The rest of
+ * the body is passed to the script as it arrives. Only bodies with a Content-Length within the
+ * limit are streamed, chunked ones are decoded once complete
+ *
+ * @return true if the request is being processed
+ */
+bool Connection::streamToCGI()
+{
+    const HTTPMethod method = _request.method();
+
+    if (_request.resource().type != CGI || (method != GET && method != POST && method != HEAD) ||
+        !_request.usesContentLength() || _request.contentLenReached())
+        return false;
+    if (fromStr<size_t>(_request.headers().at("content-length")) > _request.maxBodySize())
+        return false;
+    Log(DBUG) << "Streaming the body of " << _request.resource().originalRequest
+              << " to its CGI script" << std::endl;
+    _reqReady = true;
+    processRequest();
+    return true;
+}
+
+/**
+ * @brief Whether this is a keep-alive connection waiting for its next request
+ */
+bool Connection::idle()
+{
+    return _keepAlive && _reqReady && _request.length() == 0 && _response.length() == 0 &&
+           !_response.runningCGI();
+}
+
 bool Connection::bodySizeExceeded()
 {
     size_t maxBodySize = _request.maxBodySize();
@@ -323,23 +374,18 @@ bool Connection::bodySizeExceeded()
     if (_request.method() == HEAD)
         _response.createHEADResponse(413, NO_CONTENT, _keepAlive);
     else
-        _response.createHTMLResponse(413, errorPage(413, _request.resource()), _keepAlive);
+        _response.createErrorResponse(413, _request.resource(), _keepAlive);
     _request.clear();
     return true;
 }
 
-std::vector<char *> Connection::prepCGIEnvironment()
+CGIEnvironment Connection::prepCGIEnvironment()
 {
-    std::vector<char *> env;
-    std::string var;
+    CGIEnvironment env(Server::getConfig(_request.listener())[0]->port);
 
-    env.push_back(strdup("SERVER_SOFTWARE=Webserv/1.1"));
-    env.push_back(strdup("GATEWAY_INTERFACE=CGI/1.1"));
-    env.push_back(strdup("SERVER_PROTOCOL=HTTP/1.1"));
-    addToEnv(env, "SERVER_NAME=" + _request.hostname());
-    addToEnv(env, "SERVER_PORT=" + toStr(Server::getConfig(_request.listener())[0]->port));
-    addToEnv(env, "REQUEST_METHOD=" + enumToStr(_request.method()));
-    addToEnv(env, "REMOTE_ADDR=" + _ip);
+    env.add("SERVER_NAME", _request.hostname());
+    env.add("REQUEST_METHOD", enumToStr(_request.method()));
+    env.add("REMOTE_ADDR", _ip);
     addPathEnv(env, _request.resource());
     addHeadersToEnv(env, _request.headers());
     return env;
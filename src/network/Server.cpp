@@ -26,12 +26,22 @@
 #include "network/SystemCallException.hpp"
 #include "network/network.hpp"
 #include "responses/Response.hpp"
+#include "responses/CGICache.hpp"
+#include "responses/CGIProcess.hpp"
+#include "responses/CGIQueue.hpp"
+#include "responses/FastCGI.hpp"
+#include "responses/Compression.hpp"
+#include "responses/ErrorPages.hpp"
+#include "responses/ResponseCache.hpp"
 #include <netinet/in.h>
 #include <strings.h>
 #include <sys/fcntl.h>
 #include <sys/socket.h>
 
 bool quit = false;
+volatile sig_atomic_t logStats = 0;
+volatile sig_atomic_t purgeCaches = 0;
+static int childPipe[2] = {-1, -1};   // the SIGCHLD handler writes here to wake up poll()
 
 std::map<int, std::vector<ServerBlock *> > Server::configBlocks =
     std::map<int, std::vector<ServerBlock *> >();
@@ -40,6 +50,8 @@ Server::Server(serverList virtualServers)
 {
     std::cout << "Virtual servers - " << std::endl;
     std::cout << virtualServers << std::endl;
+    ErrorPages::preload(virtualServers);
+    FastCGIClient::startPools(virtualServers);
     std::vector<ServerBlock>::iterator it;
     for (it = virtualServers.begin(); it != virtualServers.end(); it++)
     {
@@ -97,6 +109,8 @@ std::vector<ServerBlock *> &Server::getConfig(int listener)
 void Server::closeConnection(int clientNo)
 {
     Log(INFO) << "Closing connection " << sockets[clientNo].fd << std::endl;
+    // nobody is left to read the output of a CGI request still in progress
+    cons.at(sockets[clientNo].fd).response().cancelCGI();
     close(sockets[clientNo].fd);
     cons.erase(sockets[clientNo].fd);
     sockets.erase(sockets.begin() + clientNo);
@@ -142,11 +156,71 @@ static void sigInthandler(int sigNo)
     quit = true;
 }
 
+// SIGUSR1 logs cache statistics and SIGUSR2 purges the caches
+static void sigUsrHandler(int sigNo)
+{
+    if (sigNo == SIGUSR1)
+        logStats = 1;
+    else
+        purgeCaches = 1;
+}
+
+static void sigChldHandler(int sigNo)
+{
+    const int savedErrno = errno;
+    ssize_t written;
+
+    (void) sigNo;
+    written = write(childPipe[1], "", 1);   // if the pipe is full a wakeup is pending anyway
+    (void) written;
+    errno = savedErrno;
+}
+
+static void initChildPipe()
+{
+    SystemCallException::checkErr("pipe", pipe(childPipe));
+    for (int i = 0; i < 2; i++)
+    {
+        SystemCallException::checkErr("fcntl", fcntl(childPipe[i], F_SETFL, O_NONBLOCK));
+        SystemCallException::checkErr("fcntl", fcntl(childPipe[i], F_SETFD, FD_CLOEXEC));
+    }
+}
+
+static void drainChildPipe()
+{
+    char buf[64];
+
+    while (read(childPipe[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+static void handleAdminSignals()
+{
+    if (logStats)
+    {
+        ResponseCache::getCache().logStats();
+        CompressionCache::getCache().logStats();
+        CGICache::getCache().logStats();
+        CGIQueue::logStats();
+        CGIProcess::logStats();
+    }
+    if (purgeCaches)
+    {
+        ResponseCache::getCache().purge();
+        CompressionCache::getCache().purge();
+        CGICache::getCache().purge();
+    }
+    logStats = 0;
+    purgeCaches = 0;
+}
+
 // change this to use fd directly and close stuff in caller func
 void Server::readBody(size_t clientNo)
 {
     Request &req = cons.at(sockets[clientNo].fd).request();
 
+    if (cons.at(sockets[clientNo].fd).streamToCGI())
+        return;
     if (req.usesContentLength())
     {
         if (!req.contentLenReached())
@@ -165,16 +239,20 @@ void Server::readBody(size_t clientNo)
 
 void Server::recvData(size_t clientNo)
 {
-    Request &req = cons.at(sockets[clientNo].fd).request();
+    Connection &c = cons.at(sockets[clientNo].fd);
+    Request &req = c.request();
     char *buf;
     ssize_t bytesRec;
     size_t bufSize = READ_SIZE;
 
-    if (!req.headers().empty() && req.headers().count("content-length"))
+    // a body streamed to a CGI script is read in pieces no larger than what the script may have
+    // buffered, so uploads never take their full size in memory
+    if (c.response().runningCGI())
+        bufSize = CGI_INPUT_MAX;
+    else if (!req.headers().empty() && req.headers().count("content-length"))
         bufSize = fromStr<size_t>(req.headers().at("content-length"));
     buf = new char[bufSize];
 
-    cons.at(sockets[clientNo].fd).reqReady() = false;
     Log(INFO) << "Receiving request data from connection " << sockets[clientNo].fd << "... "
               << std::endl;
     bytesRec = recv(sockets[clientNo].fd, buf, bufSize, 0);
@@ -190,7 +268,13 @@ void Server::recvData(size_t clientNo)
         delete[] buf;
         return;
     }
-    req.appendToBuffer(buf, bytesRec);
+    // the body of a request whose CGI script is already running goes straight to the script
+    const size_t bodyBytes = c.response().feedCGI(buf, bytesRec);
+    if (bodyBytes < static_cast<size_t>(bytesRec))
+    {
+        c.reqReady() = false;
+        req.appendToBuffer(buf + bodyBytes, bytesRec - bodyBytes);
+    }
     delete[] buf;
 }
 
@@ -220,20 +304,104 @@ void Server::acceptNewConnection(size_t listenerNo)
     if (sockets.size() - configBlocks.size() > MAX_CLIENTS)
     {
         cons.at(newFd).dropped() = true;
-        cons.at(newFd).response().createHTMLResponse(503, errorPage(503), false);
+        cons.at(newFd).response().createErrorResponse(503, Resource(), false);
         Log(ERR) << "Maximum clients reached, dropping this connection" << std::endl;
     }
 }
 
+/**
+ * @brief Builds the array given to poll(): the listeners and clients, followed by the SIGCHLD
+ * pipe, the connections to FastCGI applications, the scripts regenerating cached CGI responses
+ * and the pipes of the running CGI scripts
+ */
+void Server::preparePoll(std::vector<pollfd> &fds)
+{
+    for (size_t i = 0; i < sockets.size(); i++)
+        if (!configBlocks.count(sockets[i].fd))
+            sockets[i].events = cons.at(sockets[i].fd).pollEvents();
+    fds = sockets;
+    fds.push_back(createPollFd(childPipe[0], POLLIN));
+    FastCGIClient::addPollFds(fds);
+    CGICache::getCache().addPollFds(fds);
+    for (std::map<int, Connection>::iterator it = cons.begin(); it != cons.end(); it++)
+        it->second.response().addCGIPollFds(fds);
+}
+
+void Server::updateCGIs(time_t now)
+{
+    for (std::map<int, Connection>::iterator it = cons.begin(); it != cons.end(); it++)
+        it->second.response().updateCGI(now);
+}
+
+/**
+ * @brief Closes keep-alive connections that have waited longer than their timeout for another
+ * request
+ */
+void Server::closeIdleConnections(time_t now)
+{
+    for (size_t i = sockets.size(); i-- > 0;)
+    {
+        std::map<int, Connection>::iterator it = cons.find(sockets[i].fd);
+        if (it == cons.end() || !it->second.idle() ||
+            now - it->second.startTime() < it->second.timeOut())
+            continue;
+        Log(WARN) << "Connection " << sockets[i].fd << " timed out! (idle for "
+                  << it->second.timeOut() << "s)" << std::endl;
+        closeConnection(i);
+    }
+}
+
 void Server::startListening()
 {
+    std::vector<pollfd> fds;
+    time_t lastSweep = 0;
     int eventFd;
 
+    initChildPipe();
     signal(SIGPIPE, SIG_IGN);
     signal(SIGINT, sigInthandler);
+    signal(SIGUSR1, sigUsrHandler);
+    signal(SIGUSR2, sigUsrHandler);
+    signal(SIGCHLD, sigChldHandler);
     while (!quit)
     {
-        SystemCallException::checkErr("poll", poll(&sockets[0], sockets.size(), -1));
+        preparePoll(fds);
+        // wake up at least once a second to enforce the keep-alive and CGI timeouts
+        if (poll(&fds[0], fds.size(), POLL_TIMEOUT) == -1)
+        {
+            // a signal arriving during poll is not an error
+            if (errno != EINTR)
+                throw SystemCallException("poll", strerror(errno));
+            handleAdminSignals();
+            continue;
+        }
+        handleAdminSignals();
+        const time_t now = time(NULL);
+        HeaderWriter::updateDate(now);
+        // files compressed in the background are only needed once a request asks for them, so
+        // picking them up after poll() wakes up for a request is soon enough
+        CompressionCache::getCache().collect();
+
+        bool cgiEvents = now != lastSweep;
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (i < sockets.size())
+                sockets[i].revents = fds[i].revents;
+            else if (fds[i].revents != 0)
+                cgiEvents = true;
+        }
+        if (fds[sockets.size()].revents & POLLIN)
+        {
+            drainChildPipe();
+            CGIProcess::reapChildren();
+        }
+        if (cgiEvents)
+        {
+            FastCGIClient::update(fds);
+            CGICache::getCache().update(now);
+            updateCGIs(now);
+        }
+
         for (size_t i = 0; i < sockets.size(); i++)
         {
             eventFd = sockets[i].fd;
@@ -256,13 +424,28 @@ void Server::startListening()
             }
             else if ((sockets[i].revents & POLLOUT) && cons.at(eventFd).reqReady())
                 respondToRequest(i);
+            // a client that is not being read from can only report a failure or leaving this way
+            else if ((sockets[i].revents & (POLLERR | POLLHUP | POLLRDHUP)) &&
+                     !configBlocks.count(eventFd))
+                closeConnection(i);
+        }
+        if (now != lastSweep)
+        {
+            closeIdleConnections(now);
+            FastCGIClient::maintainPools();
+            CGIProcess::killStopped(now);
         }
+        lastSweep = now;
     }
 }
 
 Server::~Server()
 {
     Log(SUCCESS) << "Server destructor called" << std::endl;
+    // scripts run in their own process groups, so they do not get the terminal's SIGINT
+    CGIProcess::stopAll();
     for (size_t i = 0; i < sockets.size(); i++)
         close(sockets[i].fd);
+    close(childPipe[0]);
+    close(childPipe[1]);
 }
@@ -46,7 +46,7 @@ Request::Request(int listener)
  */
 Request::Request(const Request &req)
     : _buffer(new char[req._capacity]), _length(req._length), _capacity(req._capacity),
-      _listener(req._listener)
+      _listener(req._listener), _parser(req._parser)
 {
     std::copy(req._buffer, req._buffer + _length, _buffer);
 }
@@ -64,6 +64,7 @@ Request &Request::operator=(const Request &req)
     _length = req._length;
     _capacity = req._capacity;
     _listener = req._listener;
+    _parser = req._parser;
     delete[] _buffer;
     _buffer = new char[_capacity];
     std::copy(req._buffer, req._buffer + _length, _buffer);
@@ -164,6 +165,11 @@ const std::string Request::hostname() const
     return _parser.hostname();
 }
 
+const std::string Request::query() const
+{
+    return _parser.query();
+}
+
 int Request::listener() const
 {
     return _listener;
@@ -12,6 +12,7 @@
 #include "config/Validators.hpp"
 #include "enums/conversions.hpp"
 #include "requests/InvalidRequestError.hpp"
+#include "responses/FileCache.hpp"
 #include "utils.hpp"
 #include <algorithm>
 #include <limits>
@@ -37,6 +38,22 @@ RequestParser::RequestParser(const RequestParser &reqParser)
 {
 }
 
+RequestParser &RequestParser::operator=(const RequestParser &reqParser)
+{
+    if (&reqParser == this)
+        return *this;
+    _httpMethod = reqParser._httpMethod;
+    _keepAlive = reqParser._keepAlive;
+    _headers = reqParser._headers;
+    _hostname = reqParser._hostname;
+    _bodyStart = reqParser._bodyStart;
+    _maxSize = reqParser._maxSize;
+    _requestedURL = reqParser._requestedURL;
+    _valid = reqParser._valid;
+    _resource = reqParser._resource;
+    return *this;
+}
+
 // returns true if the headers have been fully received
 bool RequestParser::parse(const char *buffer, size_t len, const std::vector<ServerBlock *> &config)
 {
@@ -172,6 +189,17 @@ const std::string RequestParser::hostname() const
     return _hostname;
 }
 
+/**
+ * @brief Get the query string of the requested URL, without the '?'. Empty if there is none
+ */
+const std::string RequestParser::query() const
+{
+    const size_t queryPos = _requestedURL.find('?');
+    if (queryPos == std::string::npos)
+        return "";
+    return _requestedURL.substr(queryPos + 1);
+}
+
 // Clears the parser attributes
 void RequestParser::clear()
 {
@@ -457,6 +485,12 @@ Resource RequestParser::generateResource(const std::vector<ServerBlock *> &confi
     resourcePath = trimQuery(sanitizeURL(resourcePath));
 
     const std::string &trimmedRequestURL = trimQuery(_requestedURL);
+
+    // Files held by the route's open file cache don't need to be looked up on disk again
+    if ((_httpMethod == GET || _httpMethod == HEAD) && routeOptions.openFileCacheMax != 0 &&
+        !FileCache::open(resourcePath, routeOptions).isNull())
+        return Resource(EXISTING_FILE, trimmedRequestURL, resourcePath, configPair);
+
     if (!exists(resourcePath))
     {
         if (isDir(dirName(resourcePath)))
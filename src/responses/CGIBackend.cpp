@@ -0,0 +1,105 @@
+/**
+ * @file CGIBackend.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of the parts shared by all CGI backends
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/CGIBackend.hpp"
+#include "cgiUtils.hpp"
+#include "enums/HTTPMethods.hpp"
+#include "responses/CGIProcess.hpp"
+#include "responses/CGIQueue.hpp"
+#include "responses/FastCGI.hpp"
+#include "utils.hpp"
+
+size_t CGIBackend::cancelled = 0;
+
+/**
+ * @brief Takes over a request. If the request was started before its whole body arrived, the
+ * rest of the body is passed in with feed()
+ */
+CGIBackend::CGIBackend(Request &request)
+    : _bodyLeft(0), _lastActivity(time(NULL)), resource(request.resource()),
+      keepAlive(request.keepAlive()), headOnly(request.method() == HEAD), header(),
+      streaming(false), chunked(false), outputLeft(0), clientAcceptsGzip(false), gzip(),
+      failed(false)
+{
+    if (request.usesContentLength())
+    {
+        const size_t contentLength = fromStr<size_t>(request.headers().at("content-length"));
+        const size_t received = request.length() - request.bodyStart();
+        if (contentLength > received)
+            _bodyLeft = contentLength - received;
+    }
+}
+
+CGIBackend::~CGIBackend()
+{
+}
+
+size_t CGIBackend::available() const
+{
+    return 0;
+}
+
+int CGIBackend::outputPipe() const
+{
+    return -1;
+}
+
+/**
+ * @brief Restarts the timeout, used when the response starts waiting for the backend again after
+ * the client was slow to take its output
+ */
+void CGIBackend::touch()
+{
+    time(&_lastActivity);
+}
+
+/**
+ * @brief Whether the backend has made no progress for longer than GATEWAY_TIMEOUT
+ */
+bool CGIBackend::timedOut(time_t now) const
+{
+    return now - _lastActivity > GATEWAY_TIMEOUT;
+}
+
+/**
+ * @brief Starts a request, or queues it if its location already runs cgi_max_concurrency of
+ * them
+ *
+ * @return CGIHandle Null if the script or the application could not be started, or the queue is
+ * full
+ */
+CGIHandle CGIBackend::start(Request &request, const CGIEnvironment &env)
+{
+    if (request.resource().config.second.cgiMaxConcurrency != 0)
+        return CGIQueue::enter(request, env);
+    return launch(request, env);
+}
+
+/**
+ * @brief Starts a request on the backend of its location: the FastCGI application or CGI pool,
+ * or else a new process running the script
+ *
+ * @return CGIHandle Null if the script or the application could not be started
+ */
+CGIHandle CGIBackend::launch(Request &request, const CGIEnvironment &env)
+{
+    const std::string upstream = FastCGIClient::upstreamOf(request.resource().config.second);
+    int in[2];
+    int out[2];
+
+    if (!upstream.empty())
+        return FastCGIClient::start(upstream, request, env);
+    const Route &route = request.resource().config.second;
+    const pid_t pid = startCGIProcess(request.resource().path, env, route.cgiLimits, in, out);
+    if (pid == -1)
+        return CGIHandle();
+    Log(DBUG) << "Started CGI process " << pid << std::endl;
+    return CGIHandle(new CGIProcess(pid, in[1], out[0], request));
+}
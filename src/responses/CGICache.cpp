@@ -0,0 +1,397 @@
+/**
+ * @file CGICache.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of the CGI response cache
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/CGICache.hpp"
+#include "logger/Logger.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <strings.h>
+
+using logger::Log;
+
+CGICache CGICache::cache;
+
+/* ------------------------------------------------------------------------------------------ */
+/*                                        CGICacheReader                                      */
+/* ------------------------------------------------------------------------------------------ */
+
+CGICacheReader::CGICacheReader(const CGIJobHandle &job, Request &request)
+    : CGIBackend(request), _job(job), _offset(0)
+{
+}
+
+void CGICacheReader::addPollFds(std::vector<pollfd> &fds, bool wantOutput) const
+{
+    (void)fds;
+    (void)wantOutput;
+}
+
+/**
+ * @brief Only GET requests without a body are cached, so there is never a body to pass on
+ */
+size_t CGICacheReader::feed(const char *data, size_t len)
+{
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+bool CGICacheReader::inputFull() const
+{
+    return false;
+}
+
+void CGICacheReader::writeInput()
+{
+}
+
+/**
+ * @brief Copies the output the job has collected since the last call
+ *
+ * @return ssize_t 0 at the end of a complete output, -1 while the job has nothing new. A job
+ * that failed after the headers were sent fails the response as well
+ */
+ssize_t CGICacheReader::readOutput(char *buf, size_t size)
+{
+    const std::string &output = _job->output;
+
+    if (_offset < output.size())
+    {
+        size = std::min(size, output.size() - _offset);
+        memcpy(buf, output.data() + _offset, size);
+        _offset += size;
+        touch();
+        return size;
+    }
+    if (!_job->done)
+        return -1;
+    if (!_job->failed || !streaming)
+        return 0;
+    failed = true;
+    return -1;
+}
+
+void CGICacheReader::terminate()
+{
+}
+
+/* ------------------------------------------------------------------------------------------ */
+/*                                           CGICache                                         */
+/* ------------------------------------------------------------------------------------------ */
+
+CGICache::CGICache()
+    : _entries(), _jobs(), _bytes(0), _lastSweep(0), hits(0), staleHits(0), misses(0),
+      coalesced(0)
+{
+}
+
+CGICache &CGICache::getCache()
+{
+    return cache;
+}
+
+/**
+ * @brief Builds the cache key of a request from the location's key format. The script's path
+ * comes first, so two locations never share entries
+ *
+ * @param format Text with the variables $host, $request_uri, $uri, $args and $http_<name>
+ */
+std::string CGICache::key(const std::string &format, Request &request)
+{
+    const std::string &uri = request.resource().originalRequest;
+    const size_t queryStart = uri.find('?');
+    std::string key = request.resource().path + " ";
+
+    for (size_t pos = 0; pos < format.size();)
+    {
+        if (format[pos] != '$')
+        {
+            key += format[pos++];
+            continue;
+        }
+        size_t end = pos + 1;
+        while (end < format.size() && (std::isalnum(format[end]) || format[end] == '_'))
+            end++;
+        const std::string name = format.substr(pos + 1, end - pos - 1);
+        pos = end;
+        if (name == "host")
+            key += request.hostname();
+        else if (name == "request_uri")
+            key += uri;
+        else if (name == "uri")
+            key += uri.substr(0, queryStart);
+        else if (name == "args")
+            key += queryStart == std::string::npos ? "" : uri.substr(queryStart + 1);
+        else
+        {
+            // $http_accept_language is the value of the Accept-Language header
+            std::string header = name.substr(5);
+            for (size_t i = 0; i < header.size(); i++)
+                header[i] = header[i] == '_' ? '-' : std::tolower(header[i]);
+            std::map<std::string, std::string>::const_iterator value =
+                request.headers().find(header);
+            if (value != request.headers().end())
+                key += value->second;
+        }
+    }
+    return key;
+}
+
+/**
+ * @brief Gives the response of a request to a cached location. A fresh entry is replayed, a
+ * stale one is replayed while a job regenerates it, and without an entry the request reads the
+ * output of the key's job, started now unless another request already did
+ *
+ * @return CGIHandle Null if the script had to run and could not be started
+ */
+CGIHandle CGICache::open(Request &request, const CGIEnvironment &env)
+{
+    const std::string key = CGICache::key(request.resource().config.second.cgiCacheKey, request);
+    const time_t now = time(NULL);
+    std::map<std::string, Entry>::iterator entry = _entries.find(key);
+
+    if (entry != _entries.end() && now >= entry->second.staleExpires)
+    {
+        erase(entry);
+        entry = _entries.end();
+    }
+    if (entry != _entries.end() && now < entry->second.expires)
+    {
+        hits++;
+        return CGIHandle(new CGICacheReader(entry->second.response, request));
+    }
+    std::map<std::string, CGIJobHandle>::iterator running = _jobs.find(key);
+    CGIJobHandle job;
+    if (running != _jobs.end())
+        job = running->second;
+    else
+        job = startJob(key, request, env);
+    if (entry != _entries.end())
+    {
+        staleHits++;
+        return CGIHandle(new CGICacheReader(entry->second.response, request));
+    }
+    if (job.isNull())
+        return CGIHandle();
+    if (running != _jobs.end())
+        coalesced++;
+    else
+        misses++;
+    return CGIHandle(new CGICacheReader(job, request));
+}
+
+/**
+ * @brief Runs the script of a request for the cache
+ *
+ * @return CGIJobHandle Null if the script could not be started
+ */
+CGIJobHandle CGICache::startJob(const std::string &key, Request &request,
+                                const CGIEnvironment &env)
+{
+    const Route &route = request.resource().config.second;
+    CGIHandle backend = CGIBackend::start(request, env);
+
+    if (backend.isNull())
+        return CGIJobHandle();
+    // the output is never trusted to be complete if a FastCGI connection is lost
+    backend->streaming = true;
+    CGIJobHandle job(new CGICacheJob);
+    job->backend = backend;
+    job->done = false;
+    job->failed = false;
+    job->ttl = route.cgiCacheTTL;
+    job->stale = route.cgiCacheStale;
+    _jobs[key] = job;
+    Log(DBUG) << "CGI cache: generating " << key << std::endl;
+    return job;
+}
+
+/**
+ * @brief Checks that a script's output may be given to other clients: a complete header block
+ * without Set-Cookie, a status of 200 and no Cache-Control forbidding it. A Content-Length is
+ * added when the script did not send one, so hits are not sent chunked
+ *
+ * @return true if the output can be cached
+ */
+bool prepareCGICacheEntry(std::string &output)
+{
+    size_t headerEnd;
+    size_t bodyStart;
+    bool hasLength = false;
+
+    if (output.size() > CGI_CACHE_MAX_ENTRY || !findCGIHeaderEnd(output, headerEnd, bodyStart))
+        return false;
+    std::istringstream lines(output.substr(0, headerEnd));
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+        const std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        for (size_t i = 0; i < value.size(); i++)
+            value[i] = std::tolower(value[i]);
+        if (strcasecmp(name.c_str(), "Set-Cookie") == 0)
+            return false;
+        if (strcasecmp(name.c_str(), "Status") == 0 &&
+            value.find_first_not_of(' ') != value.find("200"))
+            return false;
+        if (strcasecmp(name.c_str(), "Cache-Control") == 0 &&
+            (value.find("no-store") != std::string::npos ||
+             value.find("private") != std::string::npos))
+            return false;
+        if (strcasecmp(name.c_str(), "Content-Length") == 0)
+            hasLength = true;
+    }
+    if (!hasLength)
+        output.insert(headerEnd + 1, "Content-Length: " + toStr(output.size() - bodyStart) +
+                                         "\r\n");
+    return true;
+}
+
+/**
+ * @brief Keeps the output of a finished job for its key, evicting the entries closest to
+ * expiring while the cache is over CGI_CACHE_MAX_BYTES. Readers of the job keep the original
+ */
+void CGICache::store(const std::string &key, CGICacheJob &job, time_t now)
+{
+    CGIJobHandle response(new CGICacheJob);
+
+    response->output = job.output;
+    if (job.failed || !prepareCGICacheEntry(response->output))
+    {
+        Log(DBUG) << "CGI cache: not caching " << key << std::endl;
+        return;
+    }
+    response->done = true;
+    response->failed = false;
+    response->ttl = job.ttl;
+    response->stale = job.stale;
+
+    std::map<std::string, Entry>::iterator old = _entries.find(key);
+    if (old != _entries.end())
+        erase(old);
+    while (!_entries.empty() && _bytes + response->output.size() > CGI_CACHE_MAX_BYTES)
+    {
+        std::map<std::string, Entry>::iterator oldest = _entries.begin();
+        for (std::map<std::string, Entry>::iterator it = _entries.begin(); it != _entries.end();
+             it++)
+            if (it->second.staleExpires < oldest->second.staleExpires)
+                oldest = it;
+        erase(oldest);
+    }
+    Entry &entry = _entries[key];
+    entry.response = response;
+    entry.expires = now + job.ttl;
+    entry.staleExpires = entry.expires + job.stale;
+    _bytes += response->output.size();
+}
+
+void CGICache::erase(std::map<std::string, Entry>::iterator entry)
+{
+    _bytes -= entry->second.response->output.size();
+    _entries.erase(entry);
+}
+
+/**
+ * @brief Drops the entries too old to be served even while regenerating, once a second
+ */
+void CGICache::sweep(time_t now)
+{
+    if (now == _lastSweep)
+        return;
+    _lastSweep = now;
+    std::map<std::string, Entry>::iterator it = _entries.begin();
+    while (it != _entries.end())
+    {
+        if (now >= it->second.staleExpires)
+            erase(it++);
+        else
+            it++;
+    }
+}
+
+void CGICache::addPollFds(std::vector<pollfd> &fds) const
+{
+    for (std::map<std::string, CGIJobHandle>::const_iterator it = _jobs.begin();
+         it != _jobs.end(); it++)
+        it->second->backend->addPollFds(fds, true);
+}
+
+/**
+ * @brief Collects the output of the running jobs and stores the complete ones. A job that makes
+ * no progress for longer than GATEWAY_TIMEOUT is stopped and its readers fail
+ */
+void CGICache::update(time_t now)
+{
+    char buf[CGI_READ_SIZE];
+    std::map<std::string, CGIJobHandle>::iterator it = _jobs.begin();
+
+    while (it != _jobs.end())
+    {
+        CGICacheJob &job = *it->second;
+        CGIBackend &backend = *job.backend;
+        ssize_t bytesRead;
+
+        backend.writeInput();
+        while ((bytesRead = backend.readOutput(buf, sizeof(buf))) > 0)
+        {
+            job.output.append(buf, bytesRead);
+            // the readers replay the output from memory, so it cannot grow past what is cached
+            if (job.output.size() > CGI_CACHE_MAX_ENTRY)
+            {
+                Log(ERR) << "CGI Error: output for the cache is longer than "
+                         << CGI_CACHE_MAX_ENTRY << " bytes, stopping the script" << std::endl;
+                backend.terminate();
+                backend.failed = true;
+                break;
+            }
+        }
+        if (bytesRead == -1 && backend.timedOut(now))
+        {
+            Log(ERR) << "CGI Error (504): script for the cache timed out" << std::endl;
+            backend.terminate();
+            backend.failed = true;
+        }
+        if (bytesRead == -1 && !backend.failed)
+        {
+            it++;
+            continue;
+        }
+        job.failed = backend.failed;
+        job.done = true;
+        job.backend.reset();
+        store(it->first, job, now);
+        _jobs.erase(it++);
+    }
+    sweep(now);
+}
+
+/**
+ * @brief Drops every entry, the running jobs still finish for their readers
+ */
+void CGICache::purge()
+{
+    Log(INFO) << "Purging " << _entries.size() << " cached CGI responses" << std::endl;
+    _entries.clear();
+    _bytes = 0;
+}
+
+void CGICache::logStats() const
+{
+    Log(INFO) << "CGI cache: " << _entries.size() << " entries, " << _bytes
+              << " bytes, hits = " << hits << ", stale hits = " << staleHits
+              << ", misses = " << misses << ", coalesced = " << coalesced
+              << ", running = " << _jobs.size() << std::endl;
+}
@@ -0,0 +1,248 @@
+/**
+ * @file CGIProcess.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of CGI processes driven by the event loop
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/CGIProcess.hpp"
+#include "logger/Logger.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using logger::Log;
+
+std::map<pid_t, CGIProcess *> CGIProcess::running = std::map<pid_t, CGIProcess *>();
+std::map<pid_t, time_t> CGIProcess::stopping = std::map<pid_t, time_t>();
+size_t CGIProcess::stopped = 0;
+size_t CGIProcess::killed = 0;
+
+/**
+ * @brief Takes over a started script. The part of the body received so far is written first
+ */
+CGIProcess::CGIProcess(pid_t pid, int input, int output, Request &request)
+    : CGIBackend(request), _pid(pid), _input(input), _output(output),
+      _body(request.buffer() + request.bodyStart(), request.length() - request.bodyStart()),
+      _written(0), _exited(false)
+{
+    running[_pid] = this;
+    fcntl(_output, F_SETFL, O_NONBLOCK);
+    if ((_body.empty() && _bodyLeft == 0) || fcntl(_input, F_SETFL, O_NONBLOCK) == -1)
+        closeInput();
+}
+
+CGIProcess::~CGIProcess()
+{
+    // a script that is still running is reaped later and ignored
+    running.erase(_pid);
+    closeInput();
+    close(_output);
+}
+
+void CGIProcess::closeInput()
+{
+    if (_input == -1)
+        return;
+    close(_input);   // the script sees the end of its stdin
+    _input = -1;
+}
+
+/**
+ * @brief Passes body bytes received from the client to the script
+ *
+ * @return size_t How many of the bytes belong to the body, the rest start the next request
+ */
+size_t CGIProcess::feed(const char *data, size_t len)
+{
+    if (len > _bodyLeft)
+        len = _bodyLeft;
+    _bodyLeft -= len;
+    time(&_lastActivity);
+    if (_input == -1)
+        return len;   // the script stopped reading, the rest of the body is dropped
+    if (_written == _body.size())
+    {
+        _body.clear();
+        _written = 0;
+    }
+    _body.append(data, len);
+    writeInput();
+    return len;
+}
+
+/**
+ * @brief Whether enough of the body is waiting for the script that reading from the client should
+ * pause until the script catches up
+ */
+bool CGIProcess::inputFull() const
+{
+    return _input != -1 && _body.size() - _written >= CGI_INPUT_MAX;
+}
+
+/**
+ * @brief Writes as much of the received body as the pipe takes without blocking, and closes the
+ * script's stdin once the whole body is written
+ */
+void CGIProcess::writeInput()
+{
+    if (_input == -1)
+        return;
+    while (_written < _body.size())
+    {
+        ssize_t bytesWritten = write(_input, _body.data() + _written, _body.size() - _written);
+        if (bytesWritten == -1)
+        {
+            // the script closed its stdin without reading the whole body
+            if (errno == EPIPE)
+                closeInput();
+            return;
+        }
+        _written += bytesWritten;
+        time(&_lastActivity);
+    }
+    if (_bodyLeft != 0)
+        return;
+    Log(DBUG) << "CGI process " << _pid << " got the whole body" << std::endl;
+    closeInput();
+}
+
+/**
+ * @brief Reads from the script's stdout without blocking
+ *
+ * @return ssize_t Bytes read, 0 at the end of the output, -1 if nothing is available yet
+ */
+ssize_t CGIProcess::readOutput(char *buf, size_t size)
+{
+    ssize_t bytesRead = read(_output, buf, size);
+
+    if (bytesRead > 0)
+        time(&_lastActivity);
+    return bytesRead;
+}
+
+/**
+ * @brief Bytes waiting in the stdout pipe
+ */
+size_t CGIProcess::available() const
+{
+    int bytes = 0;
+
+    if (ioctl(_output, FIONREAD, &bytes) == -1 || bytes < 0)
+        return 0;
+    return bytes;
+}
+
+int CGIProcess::outputPipe() const
+{
+    return _output;
+}
+
+/**
+ * @brief Adds the pipes the event loop should wait on for this script
+ *
+ * @param wantOutput Whether the response is waiting for more output
+ */
+void CGIProcess::addPollFds(std::vector<pollfd> &fds, bool wantOutput) const
+{
+    pollfd fd;
+
+    fd.revents = 0;
+    // while the client has not sent more of the body there is nothing to write
+    if (_input != -1 && _written < _body.size())
+    {
+        fd.fd = _input;
+        fd.events = POLLOUT;
+        fds.push_back(fd);
+    }
+    if (wantOutput)
+    {
+        fd.fd = _output;
+        fd.events = POLLIN;
+        fds.push_back(fd);
+    }
+}
+
+/**
+ * @brief Sends SIGTERM to the script's process group. The group gets SIGKILL if the script has
+ * not exited CGI_STOP_GRACE seconds later, even if this object is gone by then
+ */
+void CGIProcess::terminate()
+{
+    // until it is reaped, the script's pid cannot belong to another group
+    if (_exited || stopping.count(_pid))
+        return;
+    kill(-_pid, SIGTERM);
+    stopping[_pid] = time(NULL) + CGI_STOP_GRACE;
+    stopped++;
+}
+
+/**
+ * @brief Collects the exit status of every child that has exited, called when SIGCHLD arrives
+ */
+void CGIProcess::reapChildren()
+{
+    pid_t pid;
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        stopping.erase(pid);
+        std::map<pid_t, CGIProcess *>::iterator it = running.find(pid);
+        if (it == running.end())
+            continue;   // its response is already complete or was abandoned
+        it->second->_exited = true;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE)
+            Log(ERR) << "CGI process " << pid << " exited with error" << std::endl;
+    }
+}
+
+/**
+ * @brief Kills the process groups of the stopped scripts that are still running after their grace
+ * period, checked once a second
+ */
+void CGIProcess::killStopped(time_t now)
+{
+    std::map<pid_t, time_t>::iterator it = stopping.begin();
+
+    while (it != stopping.end())
+    {
+        if (now < it->second)
+        {
+            it++;
+            continue;
+        }
+        Log(WARN) << "CGI process " << it->first << " ignored SIGTERM, killing it" << std::endl;
+        kill(-it->first, SIGKILL);
+        killed++;
+        stopping.erase(it++);
+    }
+}
+
+/**
+ * @brief Stops every script still running when the server shuts down
+ */
+void CGIProcess::stopAll()
+{
+    for (std::map<pid_t, CGIProcess *>::iterator it = running.begin(); it != running.end(); it++)
+        if (!it->second->_exited)
+            kill(-it->first, SIGTERM);
+    for (std::map<pid_t, time_t>::iterator it = stopping.begin(); it != stopping.end(); it++)
+        kill(-it->first, SIGKILL);
+}
+
+void CGIProcess::logStats()
+{
+    Log(INFO) << "CGI processes: running = " << running.size()
+              << ", stopping = " << stopping.size() << ", stopped = " << stopped
+              << ", killed = " << killed << ", cancelled requests = " << CGIBackend::cancelled
+              << std::endl;
+}
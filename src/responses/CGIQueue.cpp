@@ -0,0 +1,269 @@
+/**
+ * @file CGIQueue.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of the per-location CGI concurrency limit
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/CGIQueue.hpp"
+#include "logger/Logger.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <sys/time.h>
+
+using logger::Log;
+
+std::map<std::string, CGIQueue::Line> CGIQueue::lines;
+
+static unsigned long milliseconds()
+{
+    timeval now;
+
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000UL + now.tv_usec / 1000;
+}
+
+/* ------------------------------------------------------------------------------------------ */
+/*                                           QueuedCGI                                        */
+/* ------------------------------------------------------------------------------------------ */
+
+QueuedCGI::QueuedCGI(Request &request, const CGIEnvironment &env)
+    : CGIBackend(request), _request(), _env(env), _body(), _backend(), _waiting(false),
+      _holdsSlot(false), _queuedAt(milliseconds())
+{
+}
+
+/**
+ * @brief Gives up the slot or the place in the queue, for a response that is complete or whose
+ * client is gone. A script still running is stopped so it does not outlive its slot
+ */
+QueuedCGI::~QueuedCGI()
+{
+    if (!_backend.isNull())
+        _backend->terminate();
+    _backend.reset();
+    CGIQueue::leave(*this);
+}
+
+void QueuedCGI::addPollFds(std::vector<pollfd> &fds, bool wantOutput) const
+{
+    if (!_backend.isNull())
+        _backend->addPollFds(fds, wantOutput);
+}
+
+/**
+ * @brief Passes body bytes to the script, or keeps them for it while waiting
+ */
+size_t QueuedCGI::feed(const char *data, size_t len)
+{
+    if (!_backend.isNull())
+        return _backend->feed(data, len);
+    if (len > _bodyLeft)
+        len = _bodyLeft;
+    _bodyLeft -= len;
+    if (_waiting)
+        _body.append(data, len);
+    return len;
+}
+
+bool QueuedCGI::inputFull() const
+{
+    if (!_backend.isNull())
+        return _backend->inputFull();
+    return _waiting && _body.size() >= CGI_INPUT_MAX;
+}
+
+void QueuedCGI::writeInput()
+{
+    if (!_backend.isNull())
+        _backend->writeInput();
+}
+
+/**
+ * @brief Reads the script's output. The slot is given to the next request as soon as the whole
+ * output is read, without waiting for the client to receive it
+ *
+ * @return ssize_t -1 while waiting, 0 at the end of the output or if the script could not be
+ * started after waiting
+ */
+ssize_t QueuedCGI::readOutput(char *buf, size_t size)
+{
+    if (_backend.isNull())
+        return _waiting ? -1 : 0;
+    _backend->streaming = streaming;
+    const ssize_t bytesRead = _backend->readOutput(buf, size);
+    if (_backend->failed)
+        failed = true;
+    if (bytesRead == 0)
+    {
+        _backend.reset();
+        CGIQueue::leave(*this);
+    }
+    return bytesRead;
+}
+
+size_t QueuedCGI::available() const
+{
+    return _backend.isNull() ? 0 : _backend->available();
+}
+
+int QueuedCGI::outputPipe() const
+{
+    return _backend.isNull() ? -1 : _backend->outputPipe();
+}
+
+void QueuedCGI::terminate()
+{
+    if (!_backend.isNull())
+        _backend->terminate();
+}
+
+void QueuedCGI::touch()
+{
+    CGIBackend::touch();
+    if (!_backend.isNull())
+        _backend->touch();
+}
+
+/**
+ * @brief Time spent in the queue does not count towards GATEWAY_TIMEOUT
+ */
+bool QueuedCGI::timedOut(time_t now) const
+{
+    return !_backend.isNull() && _backend->timedOut(now);
+}
+
+/* ------------------------------------------------------------------------------------------ */
+/*                                            CGIQueue                                        */
+/* ------------------------------------------------------------------------------------------ */
+
+CGIQueue::Line::Line()
+    : running(0), waiting(), started(0), rejected(0), waited(0), waitTotal(0), waitLongest(0)
+{
+}
+
+std::string CGIQueue::keyOf(const Resource &resource)
+{
+    const ServerBlock &block = resource.config.first;
+
+    return toStr(block.port) + " " + block.hostnames[0] + " " + resource.config.second.location;
+}
+
+/**
+ * @brief Starts the script of a request in one of the location's slots, with the body it got
+ * while waiting
+ *
+ * @return true if the script started
+ */
+bool CGIQueue::begin(Line &line, QueuedCGI &cgi, Request &request)
+{
+    cgi._backend = CGIBackend::launch(request, cgi._env);
+    if (cgi._backend.isNull())
+        return false;
+    cgi._holdsSlot = true;
+    line.running++;
+    line.started++;
+    if (!cgi._body.empty())
+    {
+        cgi._backend->feed(cgi._body.data(), cgi._body.size());
+        std::string().swap(cgi._body);
+    }
+    return true;
+}
+
+/**
+ * @brief Starts a request if its location runs fewer CGI requests than its limit, or else adds
+ * it to the end of the location's queue
+ *
+ * @return CGIHandle Null if the script could not be started, or the queue is full
+ */
+CGIHandle CGIQueue::enter(Request &request, const CGIEnvironment &env)
+{
+    const Route &route = request.resource().config.second;
+    Line &line = lines[keyOf(request.resource())];
+
+    if (line.running >= route.cgiMaxConcurrency && line.waiting.size() >= route.cgiQueue)
+    {
+        line.rejected++;
+        Log(ERR) << "CGI queue of " << route.location << " is full" << std::endl;
+        return CGIHandle();
+    }
+    QueuedCGI *cgi = new QueuedCGI(request, env);
+    CGIHandle handle(cgi);
+    if (line.running < route.cgiMaxConcurrency)
+        return begin(line, *cgi, request) ? handle : CGIHandle();
+    // the connection reuses its request as soon as this returns
+    cgi->_request = request;
+    cgi->_waiting = true;
+    line.waiting.push_back(cgi);
+    Log(DBUG) << "CGI request queued behind " << line.waiting.size() - 1 << " others on "
+              << route.location << std::endl;
+    return handle;
+}
+
+/**
+ * @brief Whether a request to the location would be turned away by enter()
+ */
+bool CGIQueue::full(const Resource &resource)
+{
+    const Route &route = resource.config.second;
+    std::map<std::string, Line>::const_iterator line = lines.find(keyOf(resource));
+
+    if (route.cgiMaxConcurrency == 0 || line == lines.end())
+        return false;
+    return line->second.running >= route.cgiMaxConcurrency &&
+           line->second.waiting.size() >= route.cgiQueue;
+}
+
+/**
+ * @brief Takes a request out of the queue, or frees its slot and starts the requests waiting
+ * for one
+ */
+void CGIQueue::leave(QueuedCGI &cgi)
+{
+    std::map<std::string, Line>::iterator it = lines.find(keyOf(cgi.resource));
+
+    if (it == lines.end())
+        return;
+    Line &line = it->second;
+    if (cgi._waiting)
+    {
+        line.waiting.erase(std::find(line.waiting.begin(), line.waiting.end(), &cgi));
+        cgi._waiting = false;
+        return;
+    }
+    if (!cgi._holdsSlot)
+        return;
+    cgi._holdsSlot = false;
+    line.running--;
+    while (line.running < cgi.resource.config.second.cgiMaxConcurrency && !line.waiting.empty())
+    {
+        QueuedCGI &next = *line.waiting.front();
+        const unsigned long waited = milliseconds() - next._queuedAt;
+
+        line.waiting.pop_front();
+        next._waiting = false;
+        line.waited++;
+        line.waitTotal += waited;
+        line.waitLongest = std::max(line.waitLongest, waited);
+        if (!begin(line, next, next._request))
+            Log(ERR) << "CGI error: could not start a queued script" << std::endl;
+        next._request.clear();
+    }
+}
+
+void CGIQueue::logStats()
+{
+    for (std::map<std::string, Line>::const_iterator it = lines.begin(); it != lines.end(); it++)
+    {
+        const Line &line = it->second;
+        Log(INFO) << "CGI queue " << it->first << ": running = " << line.running
+                  << ", waiting = " << line.waiting.size() << ", started = " << line.started
+                  << ", rejected = " << line.rejected << ", waited = " << line.waited
+                  << ", average wait = " << (line.waited ? line.waitTotal / line.waited : 0)
+                  << "ms, longest wait = " << line.waitLongest << "ms" << std::endl;
+    }
+}
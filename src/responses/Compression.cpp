@@ -0,0 +1,322 @@
+/**
+ * @file Compression.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of gzip compression and the compressed file cache
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/Compression.hpp"
+#include "logger/Logger.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using logger::Log;
+
+#define GZIP_WINDOW (15 + 16)   // maximum window size, with a gzip header and trailer
+
+CompressionCache CompressionCache::cache;
+
+/**
+ * @brief Compresses the next piece of input, appending whatever zlib produces to the output
+ */
+static bool deflateChunk(z_stream &stream, const char *data, size_t length, int flush,
+                         std::string &out)
+{
+    char chunk[COMPRESS_CHUNK];
+    int status;
+
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = length;
+    do
+    {
+        stream.next_out = reinterpret_cast<Bytef *>(chunk);
+        stream.avail_out = sizeof(chunk);
+        status = deflate(&stream, flush);
+        if (status == Z_STREAM_ERROR)
+            return false;
+        out.append(chunk, sizeof(chunk) - stream.avail_out);
+    } while (stream.avail_out == 0);
+    return flush != Z_FINISH || status == Z_STREAM_END;
+}
+
+static bool gzipInit(z_stream &stream, int level)
+{
+    memset(&stream, 0, sizeof(stream));
+    return deflateInit2(&stream, level, Z_DEFLATED, GZIP_WINDOW, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+/**
+ * @brief Gzips a buffer in memory
+ *
+ * @return true if the output holds the complete gzip stream
+ */
+bool gzipCompress(const char *data, size_t length, int level, std::string &out)
+{
+    z_stream stream;
+
+    if (!gzipInit(stream, level))
+        return false;
+    out.reserve(length / 2);
+    bool success = deflateChunk(stream, data, length, Z_FINISH, out);
+    deflateEnd(&stream);
+    return success;
+}
+
+/**
+ * @brief Gzips a file, reading it a chunk at a time
+ *
+ * @return true if the output holds the complete gzip stream
+ */
+bool gzipCompressFile(int fd, off_t size, int level, std::string &out)
+{
+    char chunk[COMPRESS_CHUNK];
+    z_stream stream;
+    ssize_t bytesRead;
+    bool success = true;
+
+    if (!gzipInit(stream, level))
+        return false;
+    out.reserve(size / 2);
+    for (off_t offset = 0; success && offset < size; offset += bytesRead)
+    {
+        bytesRead = pread(fd, chunk, sizeof(chunk), offset);
+        if (bytesRead <= 0)
+            success = false;
+        else
+            success = deflateChunk(stream, chunk, bytesRead,
+                                   offset + bytesRead < size ? Z_NO_FLUSH : Z_FINISH, out);
+    }
+    deflateEnd(&stream);
+    return success;
+}
+
+GzipStream::GzipStream(int level) : _stream(new z_stream), _open(false)
+{
+    _open = gzipInit(*_stream, level);
+}
+
+GzipStream::~GzipStream()
+{
+    if (_open)
+        deflateEnd(_stream);
+    delete _stream;
+}
+
+/**
+ * @brief Compresses the next piece of the body, appending it to the output
+ *
+ * @param last Whether this is the end of the body, which ends the gzip stream
+ * @return false if the stream could not be compressed
+ */
+bool GzipStream::compress(const char *data, size_t length, bool last, std::string &out)
+{
+    if (!_open)
+        return false;
+    if (length == 0 && !last)
+        return true;
+    return deflateChunk(*_stream, data, length, last ? Z_FINISH : Z_SYNC_FLUSH, out);
+}
+
+CompressionCache::CompressionCache()
+    : _entries(), _lru(), _bytes(0), _pending(), _jobs(), _done(), _workerStarted(false), hits(0),
+      misses(0)
+{
+    // the mutex and condition are never destroyed: the worker may still be waiting on them
+    // when the process exits
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_wake, NULL);
+}
+
+CompressionCache &CompressionCache::getCache()
+{
+    return cache;
+}
+
+void CompressionCache::evict(std::map<std::string, Entry>::iterator entry)
+{
+    // responses still sending the compressed file hold their own reference to it
+    _bytes -= entry->second.data->size();
+    _lru.erase(entry->second.lruPos);
+    _entries.erase(entry);
+}
+
+/**
+ * @brief Gets the compressed contents of a file if they were made from the file's current
+ * version at the same compression level
+ */
+BufferHandle CompressionCache::find(const std::string &path, const OpenFile &file, int level)
+{
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+
+    if (it == _entries.end())
+    {
+        misses++;
+        return BufferHandle();
+    }
+    const Entry &entry = it->second;
+    if (entry.mtime != file.mtime || entry.inode != file.inode || entry.device != file.device ||
+        entry.size != file.size || entry.level != level)
+    {
+        evict(it);
+        misses++;
+        return BufferHandle();
+    }
+    _lru.splice(_lru.begin(), _lru, it->second.lruPos);
+    hits++;
+    return it->second.data;
+}
+
+void CompressionCache::insert(const std::string &path, const OpenFile &file, int level,
+                              const BufferHandle &data)
+{
+    if (data->size() > COMPRESSION_CACHE_MAX_BYTES)
+        return;
+    std::map<std::string, Entry>::iterator old = _entries.find(path);
+    if (old != _entries.end())
+        evict(old);
+    while (_bytes + data->size() > COMPRESSION_CACHE_MAX_BYTES)
+        evict(_entries.find(_lru.back()));
+
+    Entry &entry = _entries[path];
+    entry.data = data;
+    entry.mtime = file.mtime;
+    entry.inode = file.inode;
+    entry.device = file.device;
+    entry.size = file.size;
+    entry.level = level;
+    _lru.push_front(path);
+    entry.lruPos = _lru.begin();
+    _bytes += data->size();
+}
+
+/**
+ * @brief Worker thread: compresses queued files one at a time
+ */
+void *CompressionCache::work(void *arg)
+{
+    CompressionCache &self = *static_cast<CompressionCache *>(arg);
+    struct stat info;
+
+    while (true)
+    {
+        pthread_mutex_lock(&self._lock);
+        while (self._jobs.empty())
+            pthread_cond_wait(&self._wake, &self._lock);
+        Job job = self._jobs.front();
+        self._jobs.pop_front();
+        pthread_mutex_unlock(&self._lock);
+
+        // the file may have changed since the job was queued, only its queued version is used
+        job.result = NULL;
+        int fd = open(job.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd != -1 && fstat(fd, &info) == 0 && info.st_mtime == job.mtime &&
+            info.st_ino == job.inode && info.st_dev == job.device && info.st_size == job.size)
+        {
+            job.result = new std::string;
+            if (!gzipCompressFile(fd, job.size, job.level, *job.result))
+            {
+                delete job.result;
+                job.result = NULL;
+            }
+        }
+        if (fd != -1)
+            close(fd);
+
+        pthread_mutex_lock(&self._lock);
+        self._done.push_back(job);
+        pthread_mutex_unlock(&self._lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Queues a file to be compressed by the worker thread, unless it already is
+ */
+void CompressionCache::schedule(const std::string &path, const OpenFile &file, int level)
+{
+    if (_pending.count(path) != 0)
+        return;
+    if (!_workerStarted)
+    {
+        pthread_t worker;
+        const int rc = pthread_create(&worker, NULL, work, this);
+        if (rc != 0)
+        {
+            // pthread_create returns its error instead of setting errno
+            Log(ERR) << "Could not start the compression worker: " << strerror(rc) << std::endl;
+            return;
+        }
+        pthread_detach(worker);
+        _workerStarted = true;
+    }
+    Job job;
+    job.path = path;
+    job.mtime = file.mtime;
+    job.inode = file.inode;
+    job.device = file.device;
+    job.size = file.size;
+    job.level = level;
+    job.result = NULL;
+    _pending.insert(path);
+
+    pthread_mutex_lock(&_lock);
+    _jobs.push_back(job);
+    pthread_cond_signal(&_wake);
+    pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * @brief Moves files compressed by the worker into the cache. Called once per event loop
+ * iteration, so the cache itself is only ever touched by the event loop
+ */
+void CompressionCache::collect()
+{
+    std::deque<Job> done;
+
+    if (_pending.empty())
+        return;
+    pthread_mutex_lock(&_lock);
+    done.swap(_done);
+    pthread_mutex_unlock(&_lock);
+    for (std::deque<Job>::iterator job = done.begin(); job != done.end(); job++)
+    {
+        _pending.erase(job->path);
+        if (job->result == NULL)
+            continue;
+        OpenFile version;
+        version.mtime = job->mtime;
+        version.inode = job->inode;
+        version.device = job->device;
+        version.size = job->size;
+        insert(job->path, version, job->level, BufferHandle(job->result));
+        Log(DBUG) << "Compressed " << job->path << " in the background" << std::endl;
+    }
+}
+
+void CompressionCache::invalidate(const std::string &path)
+{
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end())
+        evict(it);
+}
+
+void CompressionCache::purge()
+{
+    Log(INFO) << "Purging " << _entries.size() << " compressed files" << std::endl;
+    _entries.clear();
+    _lru.clear();
+    _bytes = 0;
+}
+
+void CompressionCache::logStats() const
+{
+    Log(INFO) << "Compression cache: " << _entries.size() << " entries, " << _bytes
+              << " bytes, hits = " << hits << ", misses = " << misses
+              << ", pending = " << _pending.size() << std::endl;
+}
@@ -0,0 +1,444 @@
+/**
+ * @file DirectoryListing.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of directory reading, listing pages and the listing cache
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/DirectoryListing.hpp"
+#include "responses/DefaultPages.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/syscall.h>
+
+// Layout of the records filled in by getdents64(), which glibc does not declare
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+
+#define MAX_PER_PAGE 100000
+
+std::map<std::string, ListingCache::Entry> ListingCache::entries;
+std::list<std::string> ListingCache::lru;
+size_t ListingCache::bytes = 0;
+
+#ifdef __linux__
+DirectoryReader::DirectoryReader() : _fd(-1), _buffer(NULL)
+{
+}
+
+DirectoryReader::~DirectoryReader()
+{
+    if (_fd != -1)
+        close(_fd);
+    delete[] _buffer;
+}
+
+bool DirectoryReader::open(const std::string &path)
+{
+    _fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (_fd == -1)
+        return false;
+    _buffer = new char[LISTING_BATCH];
+    return true;
+}
+
+/**
+ * @brief Reads the next batch of names, as many as fit in one getdents64() call
+ *
+ * @return ssize_t Number of names read, 0 at the end of the directory, -1 on error
+ */
+ssize_t DirectoryReader::read(std::vector<std::string> &names)
+{
+    const long length = syscall(SYS_getdents64, _fd, _buffer, LISTING_BATCH);
+    ssize_t count = 0;
+
+    if (length <= 0)
+        return length;
+    for (long pos = 0; pos < length; count++)
+    {
+        const LinuxDirent64 *entry = reinterpret_cast<const LinuxDirent64 *>(_buffer + pos);
+        names.push_back(entry->d_name);
+        pos += entry->d_reclen;
+    }
+    return count;
+}
+#else
+DirectoryReader::DirectoryReader() : _dir(NULL)
+{
+}
+
+DirectoryReader::~DirectoryReader()
+{
+    if (_dir != NULL)
+        closedir(_dir);
+}
+
+bool DirectoryReader::open(const std::string &path)
+{
+    _dir = opendir(path.c_str());
+    return _dir != NULL;
+}
+
+ssize_t DirectoryReader::read(std::vector<std::string> &names)
+{
+    ssize_t count = 0;
+
+    for (struct dirent *entry = NULL; count < LISTING_BATCH_ENTRIES; count++)
+    {
+        entry = readdir(_dir);
+        if (entry == NULL)
+            break;
+        names.push_back(entry->d_name);
+    }
+    return count;
+}
+#endif
+
+static bool parseCount(const std::string &str, size_t &count)
+{
+    if (str.empty() || str.length() > 9)
+        return false;
+    for (size_t i = 0; i < str.length(); i++)
+        if (!std::isdigit(str[i]))
+            return false;
+    count = fromStr<size_t>(str);
+    return true;
+}
+
+ListingOptions::ListingOptions(const std::string &query)
+    : sorted(false), descending(false), page(0), perPage(LISTING_PER_PAGE)
+{
+    size_t start = 0;
+
+    while (start < query.length())
+    {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos)
+            end = query.length();
+        const std::string &param = query.substr(start, end - start);
+        const size_t equals = param.find('=');
+        const std::string &name = param.substr(0, equals);
+        const std::string &value = equals == std::string::npos ? "" : param.substr(equals + 1);
+        if (name == "sort")
+            sorted = value == "name";
+        else if (name == "order")
+            descending = value == "desc";
+        else if (name == "page")
+            parseCount(value, page);
+        else if (name == "per_page" && parseCount(value, perPage))
+            perPage = std::max<size_t>(1, std::min<size_t>(perPage, MAX_PER_PAGE));
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief Checks if the listing is the whole directory in the order it is read, which is the only
+ * kind of listing that can be sent before the directory is read to the end
+ */
+bool ListingOptions::wholeDirectory() const
+{
+    return !sorted && page == 0;
+}
+
+/**
+ * @brief Builds a query string asking for another page of the same listing
+ */
+std::string ListingOptions::query(size_t pageNumber) const
+{
+    std::string query;
+
+    if (sorted)
+        query += "sort=name&";
+    if (descending)
+        query += "order=desc&";
+    if (pageNumber != 0)
+        query += "page=" + toStr(pageNumber) + "&per_page=" + toStr(perPage) + "&";
+    if (!query.empty())
+        query.erase(query.length() - 1);
+    return query;
+}
+
+static void appendEscapedHTML(std::string &html, const std::string &text)
+{
+    for (std::string::const_iterator it = text.begin(); it != text.end(); it++)
+    {
+        if (*it == '&')
+            html += "&amp;";
+        else if (*it == '<')
+            html += "&lt;";
+        else if (*it == '>')
+            html += "&gt;";
+        else if (*it == '"')
+            html += "&quot;";
+        else
+            html += *it;
+    }
+}
+
+/**
+ * @brief Percent-encodes a file name for use in a URL path
+ */
+static void appendEncodedURL(std::string &url, const std::string &name)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    for (std::string::const_iterator it = name.begin(); it != name.end(); it++)
+    {
+        const unsigned char c = *it;
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+            url += c;
+        else
+        {
+            url += '%';
+            url += hex[c >> 4];
+            url += hex[c & 15];
+        }
+    }
+}
+
+ListingWriter::ListingWriter(const std::string &url)
+    : _title(), _urlPrefix(sanitizeURL(url + "/"))
+{
+    appendEscapedHTML(_title, url);
+}
+
+void ListingWriter::head(std::string &html) const
+{
+    html += COMMON_HEAD "\t\t<title>Directory listing for " + _title +
+            " </title>\n"
+            "\t</head>\n"
+            "\t<body>\n"
+            "\t\t<h1>Directory listing for " +
+            _title +
+            " </h1>\n"
+            "\t\t<hr>\n"
+            "\t\t<ul>\n";
+}
+
+/**
+ * @brief Appends the entries in [first, last) of a list of names
+ */
+void ListingWriter::entries(std::string &html, const std::vector<std::string> &names,
+                            size_t first, size_t last) const
+{
+    last = std::min(last, names.size());
+    for (size_t i = first; i < last; i++)
+    {
+        html += "\t\t\t<li><a href=\"";
+        appendEscapedHTML(html, _urlPrefix);
+        appendEncodedURL(html, names[i]);
+        html += "\">";
+        appendEscapedHTML(html, names[i]);
+        html += "</a></li>\n";
+    }
+}
+
+void ListingWriter::tail(std::string &html, const ListingOptions &options, bool morePages) const
+{
+    html += "\t\t</ul>\n";
+    if (options.page > 1)
+    {
+        html += "\t\t<a href=\"?";
+        appendEscapedHTML(html, options.query(options.page - 1));
+        html += "\">previous</a>\n";
+    }
+    if (morePages)
+    {
+        html += "\t\t<a href=\"?";
+        appendEscapedHTML(html, options.query(options.page + 1));
+        html += "\">next</a>\n";
+    }
+    html += "\t\t<hr>\n\t</body>\n</html>\n";
+}
+
+/**
+ * @brief Renders a complete listing of a directory whose names were all read. The names are
+ * sorted in place if the listing asks for it
+ */
+const std::string renderListing(const Resource &dir, const ListingOptions &options,
+                                std::vector<std::string> &names)
+{
+    const ListingWriter writer(dir.originalRequest);
+    size_t first = 0;
+    size_t last = names.size();
+    std::string html;
+
+    if (options.sorted)
+    {
+        std::sort(names.begin(), names.end());
+        if (options.descending)
+            std::reverse(names.begin(), names.end());
+    }
+    if (options.page != 0)
+    {
+        first = std::min((options.page - 1) * options.perPage, names.size());
+        last = std::min(first + options.perPage, names.size());
+    }
+    html.reserve((last - first) * 64 + 1024);
+    writer.head(html);
+    writer.entries(html, names, first, last);
+    writer.tail(html, options, last < names.size());
+    return html;
+}
+
+std::string ListingCache::key(const Resource &dir, const ListingOptions &options)
+{
+    return dir.path + "\n" + dir.originalRequest + "\n" + options.query(options.page);
+}
+
+/**
+ * @brief Gets what identifies the current contents of a directory
+ *
+ * @return false if the directory cannot be accessed
+ */
+bool ListingCache::version(const std::string &path, Version &version)
+{
+    struct stat info;
+
+    if (stat(path.c_str(), &info) == -1 || !S_ISDIR(info.st_mode))
+        return false;
+    version.mtime = info.st_mtime;
+#ifdef __linux__
+    version.mtimeNsec = info.st_mtim.tv_nsec;
+#else
+    version.mtimeNsec = info.st_mtimespec.tv_nsec;
+#endif
+    version.inode = info.st_ino;
+    return true;
+}
+
+void ListingCache::evict(std::map<std::string, Entry>::iterator entry)
+{
+    bytes -= entry->second.page->size();
+    lru.erase(entry->second.lruPos);
+    entries.erase(entry);
+}
+
+BufferHandle ListingCache::find(const std::string &key, const Version &version)
+{
+    std::map<std::string, Entry>::iterator it = entries.find(key);
+
+    if (it == entries.end())
+        return BufferHandle();
+    const Entry &entry = it->second;
+    if (entry.mtime != version.mtime || entry.mtimeNsec != version.mtimeNsec ||
+        entry.inode != version.inode)
+    {
+        evict(it);
+        return BufferHandle();
+    }
+    lru.splice(lru.begin(), lru, it->second.lruPos);
+    return it->second.page;
+}
+
+void ListingCache::insert(const std::string &key, const Version &version,
+                          const BufferHandle &page)
+{
+    if (page->size() > LISTING_CACHE_MAX_BYTES)
+        return;
+    std::map<std::string, Entry>::iterator old = entries.find(key);
+    if (old != entries.end())
+        evict(old);
+    while (bytes + page->size() > LISTING_CACHE_MAX_BYTES)
+        evict(entries.find(lru.back()));
+
+    Entry &entry = entries[key];
+    entry.page = page;
+    entry.mtime = version.mtime;
+    entry.mtimeNsec = version.mtimeNsec;
+    entry.inode = version.inode;
+    lru.push_front(key);
+    entry.lruPos = lru.begin();
+    bytes += page->size();
+}
+
+DirectoryStream::DirectoryStream(const Resource &dir, const std::string &key,
+                                 const ListingCache::Version &version)
+    : _reader(), _writer(dir.originalRequest), _names(), _key(key), _version(version), _page(),
+      _cacheable(true), _started(false), _finished(false)
+{
+}
+
+bool DirectoryStream::open(const std::string &path)
+{
+    return _reader.open(path);
+}
+
+/**
+ * @brief Reads batches of names until at least count names are waiting to be sent
+ *
+ * @return true if the whole directory was read
+ */
+bool DirectoryStream::readAhead(size_t count)
+{
+    while (!_finished && _names.size() < count)
+    {
+        ssize_t read = _reader.read(_names);
+        if (read < 0)
+            return false;
+        _finished = read == 0;
+    }
+    return _finished;
+}
+
+std::vector<std::string> &DirectoryStream::names()
+{
+    return _names;
+}
+
+/**
+ * @brief Appends the next batch of entries. The first piece starts with the page head and the
+ * last one ends with the page tail
+ */
+int DirectoryStream::read(std::string &out)
+{
+    const size_t start = out.size();
+
+    if (!_started)
+        _writer.head(out);
+    _started = true;
+    if (_names.empty() && !_finished)
+    {
+        ssize_t count = _reader.read(_names);
+        if (count < 0)
+            return STREAM_ERROR;
+        _finished = count == 0;
+    }
+    _writer.entries(out, _names);
+    _names.clear();
+    if (_finished)
+        _writer.tail(out, ListingOptions(), false);
+
+    if (_cacheable && _page.size() + out.size() - start > LISTING_CACHE_MAX_BYTES)
+    {
+        _cacheable = false;
+        std::string().swap(_page);
+    }
+    if (_cacheable)
+        _page.append(out, start, std::string::npos);
+    if (!_finished)
+        return STREAM_DATA;
+    if (_cacheable)
+    {
+        std::string *page = new std::string;
+        page->swap(_page);
+        ListingCache::insert(_key, _version, BufferHandle(page));
+    }
+    return STREAM_END;
+}
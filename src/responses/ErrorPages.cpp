@@ -0,0 +1,144 @@
+/**
+ * @file ErrorPages.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of the error page store
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/ErrorPages.hpp"
+#include "logger/Logger.hpp"
+#include "responses/Compression.hpp"
+#include "responses/DefaultPages.hpp"
+#include "utils.hpp"
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+using logger::Log;
+
+std::map<unsigned int, ErrorPage> ErrorPages::builtIn;
+std::map<std::string, ErrorPage> ErrorPages::files;
+
+ErrorPage::ErrorPage()
+    : body(), gzipped(), gzipLevel(0), path(), mtime(0), inode(0), size(0), validated(0)
+{
+}
+
+/**
+ * @brief Loads every configured error page, and the built-in pages of the errors we send
+ */
+void ErrorPages::preload(const std::vector<ServerBlock> &config)
+{
+    static const unsigned int codes[] = {400, 404, 405, 409, 413, 416, 500, 502, 503, 504};
+
+    for (size_t i = 0; i < sizeOfArray(codes); i++)
+        builtInPage(codes[i]);
+    for (std::vector<ServerBlock>::const_iterator block = config.begin(); block != config.end();
+         block++)
+    {
+        for (std::map<unsigned int, std::string>::const_iterator it = block->errorPages.begin();
+             it != block->errorPages.end(); it++)
+        {
+            if (files.count(it->second) != 0)
+                continue;
+            ErrorPage page;
+            if (load(it->second, page))
+                files[it->second] = page;
+            else
+                Log(WARN) << "Cannot read error page " << it->second << std::endl;
+        }
+    }
+}
+
+ErrorPage &ErrorPages::builtInPage(unsigned int statusCode)
+{
+    ErrorPage &page = builtIn[statusCode];
+
+    if (page.body.isNull())
+        page.body = BufferHandle(new std::string(DEFAULT_ERROR(statusCode)));
+    return page;
+}
+
+bool ErrorPages::load(const std::string &path, ErrorPage &page)
+{
+    struct stat info;
+
+    if (stat(path.c_str(), &info) == -1)
+        return false;
+    std::ifstream errorFile(path.c_str());
+    if (!errorFile)
+        return false;
+    std::stringstream errorFileStream;
+    errorFileStream << errorFile.rdbuf();
+
+    page.body = BufferHandle(new std::string(errorFileStream.str()));
+    page.gzipped.reset();
+    page.path = path;
+    page.mtime = info.st_mtime;
+    page.inode = info.st_ino;
+    page.size = info.st_size;
+    page.validated = time(NULL);
+    return true;
+}
+
+bool ErrorPages::stillValid(ErrorPage &page, time_t now)
+{
+    struct stat info;
+
+    if (now - page.validated < ERROR_PAGE_REVALIDATE)
+        return true;
+    if (stat(page.path.c_str(), &info) == -1 || info.st_mtime != page.mtime ||
+        info.st_ino != page.inode || info.st_size != page.size)
+        return false;
+    page.validated = now;
+    return true;
+}
+
+/**
+ * @brief Gets the page to send for an error: the server block's error_page for the status code
+ * if it is readable, otherwise the built-in page
+ */
+ErrorPage &ErrorPages::find(unsigned int statusCode, const Resource &resource)
+{
+    const std::map<unsigned int, std::string> &errorPages = resource.config.first.errorPages;
+    std::map<unsigned int, std::string>::const_iterator configured = errorPages.find(statusCode);
+
+    if (configured == errorPages.end())
+        return builtInPage(statusCode);
+    std::map<std::string, ErrorPage>::iterator it = files.find(configured->second);
+    if (it != files.end() && stillValid(it->second, time(NULL)))
+        return it->second;
+
+    // responses still sending the old page hold their own reference to its body
+    ErrorPage page;
+    if (!load(configured->second, page))
+    {
+        if (it != files.end())
+            files.erase(it);
+        return builtInPage(statusCode);
+    }
+    Log(DBUG) << "Reloaded error page " << configured->second << std::endl;
+    ErrorPage &stored = files[configured->second];
+    stored = page;
+    return stored;
+}
+
+/**
+ * @brief Gets the gzipped body of a page, compressing it the first time it is asked for at a
+ * compression level
+ *
+ * @return const BufferHandle& The compressed body, null if compression failed
+ */
+const BufferHandle &ErrorPages::compressed(ErrorPage &page, int level)
+{
+    if (!page.gzipped.isNull() && page.gzipLevel == level)
+        return page.gzipped;
+    page.gzipped = BufferHandle(new std::string);
+    page.gzipLevel = level;
+    if (!gzipCompress(page.body->data(), page.body->length(), level, *page.gzipped))
+        page.gzipped.reset();
+    return page.gzipped;
+}
@@ -0,0 +1,839 @@
+/**
+ * @file FastCGI.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of the FastCGI client
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/FastCGI.hpp"
+#include "logger/Logger.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define FCGI_VERSION_1         1
+#define FCGI_BEGIN_REQUEST     1
+#define FCGI_ABORT_REQUEST     2
+#define FCGI_END_REQUEST       3
+#define FCGI_PARAMS            4
+#define FCGI_STDIN             5
+#define FCGI_STDOUT            6
+#define FCGI_STDERR            7
+#define FCGI_GET_VALUES        9
+#define FCGI_GET_VALUES_RESULT 10
+#define FCGI_RESPONDER         1
+#define FCGI_KEEP_CONN         1
+#define FCGI_REQUEST_COMPLETE  0
+#define FCGI_MPXS_CONNS        "FCGI_MPXS_CONNS"
+
+using logger::Log;
+
+extern char **environ;
+
+std::map<std::string, FastCGIUpstream> FastCGIClient::upstreams =
+    std::map<std::string, FastCGIUpstream>();
+std::map<int, FastCGIConnection *> FastCGIClient::connections =
+    std::map<int, FastCGIConnection *>();
+size_t FastCGIClient::pollStart = 0;
+size_t FastCGIClient::pollCount = 0;
+
+/**
+ * @brief Appends the length of a name or value, in one byte below 128 and in four otherwise
+ */
+static void appendLength(std::string &out, size_t len)
+{
+    if (len < 0x80)
+    {
+        out += static_cast<char>(len);
+        return;
+    }
+    out += static_cast<char>(0x80 | ((len >> 24) & 0x7f));
+    out += static_cast<char>((len >> 16) & 0xff);
+    out += static_cast<char>((len >> 8) & 0xff);
+    out += static_cast<char>(len & 0xff);
+}
+
+static void appendPair(std::string &out, const char *name, size_t nameLength, const char *value,
+                       size_t valueLength)
+{
+    appendLength(out, nameLength);
+    appendLength(out, valueLength);
+    out.append(name, nameLength).append(value, valueLength);
+}
+
+/**
+ * @brief Reads a length written by appendLength()
+ *
+ * @return false if the content ends before the length does
+ */
+static bool readLength(const unsigned char *&pos, const unsigned char *end, size_t &len)
+{
+    if (pos == end)
+        return false;
+    if (!(*pos & 0x80))
+    {
+        len = *pos++;
+        return true;
+    }
+    if (end - pos < 4)
+        return false;
+    len = (static_cast<size_t>(pos[0] & 0x7f) << 24) | (pos[1] << 16) | (pos[2] << 8) | pos[3];
+    pos += 4;
+    return true;
+}
+
+/* ------------------------------------------------------------------------------------------ */
+/*                                      FastCGIConnection                                     */
+/* ------------------------------------------------------------------------------------------ */
+
+/**
+ * @brief Takes over a connected socket, or one whose connect() is in progress, and asks the
+ * application whether it accepts several requests at once
+ */
+FastCGIConnection::FastCGIConnection(FastCGIUpstream &app, int fd, bool connecting)
+    : _fd(fd), _connecting(connecting), _out(), _outStart(0), _in(), _nextId(0),
+      upstream(app), requests(), multiplexes(false), worker(-1), served(0)
+{
+    std::string values;
+
+    appendPair(values, FCGI_MPXS_CONNS, sizeof(FCGI_MPXS_CONNS) - 1, "", 0);
+    queue(FCGI_GET_VALUES, 0, values.data(), values.size());
+}
+
+/**
+ * @brief Closes the connection, requests still on it get an incomplete output
+ */
+FastCGIConnection::~FastCGIConnection()
+{
+    for (std::map<unsigned short, FastCGIRequest *>::iterator it = requests.begin();
+         it != requests.end(); it++)
+        if (it->second != NULL)
+            it->second->connectionLost();
+    ::close(_fd);
+    // a worker exits when it sees the end of its stdin, but may be busy or stuck
+    if (worker != -1)
+        kill(worker, SIGTERM);
+}
+
+int FastCGIConnection::fd() const
+{
+    return _fd;
+}
+
+bool FastCGIConnection::connecting() const
+{
+    return _connecting;
+}
+
+/**
+ * @brief Whether a request has so much output waiting for its client that reading more from the
+ * application should pause
+ */
+bool FastCGIConnection::backedUp() const
+{
+    for (std::map<unsigned short, FastCGIRequest *>::const_iterator it = requests.begin();
+         it != requests.end(); it++)
+        if (it->second != NULL && it->second->buffered() >= FASTCGI_OUTPUT_MAX)
+            return true;
+    return false;
+}
+
+short FastCGIConnection::pollEvents() const
+{
+    if (_connecting)
+        return POLLOUT;
+    return (backedUp() ? 0 : POLLIN) | (pending() != 0 ? POLLOUT : 0);
+}
+
+/**
+ * @brief Bytes of records waiting to be written
+ */
+size_t FastCGIConnection::pending() const
+{
+    return _out.size() - _outStart;
+}
+
+/**
+ * @brief Whether a cgi_pool worker has handled its share of requests and gets no new ones
+ */
+bool FastCGIConnection::retired() const
+{
+    return upstream.maxRequests != 0 && served >= upstream.maxRequests;
+}
+
+/**
+ * @brief Finds an id that no request on this connection uses. Aborted requests keep their id
+ * until the application ends them
+ */
+unsigned short FastCGIConnection::reserveId()
+{
+    do
+        _nextId++;
+    while (_nextId == 0 || requests.count(_nextId));
+    return _nextId;
+}
+
+/**
+ * @brief Queues a record, split in several if the content is too long for one. An empty record
+ * ends the stream of its type
+ */
+void FastCGIConnection::queue(unsigned char type, unsigned short id, const char *data, size_t len)
+{
+    if (_outStart == _out.size())
+    {
+        _out.clear();
+        _outStart = 0;
+    }
+    do
+    {
+        const size_t part = std::min(len, static_cast<size_t>(FASTCGI_CONTENT));
+        const char header[FASTCGI_RECORD] = {FCGI_VERSION_1,
+                                             static_cast<char>(type),
+                                             static_cast<char>(id >> 8),
+                                             static_cast<char>(id & 0xff),
+                                             static_cast<char>(part >> 8),
+                                             static_cast<char>(part & 0xff),
+                                             0,
+                                             0};
+        _out.append(header, FASTCGI_RECORD);
+        _out.append(data, part);
+        data += part;
+        len -= part;
+    } while (len != 0);
+}
+
+/**
+ * @brief Queues the CGI environment of a request as its FCGI_PARAMS stream. The application
+ * runs the script itself, so it gets the script's absolute path
+ */
+void FastCGIConnection::queueParams(unsigned short id, const CGIEnvironment &env,
+                                    const std::string &scriptPath)
+{
+    const std::string &block = env.block();
+    std::string params;
+
+    params.reserve(block.size() + scriptPath.size() + 64);
+    for (size_t start = 0, end; start < block.size(); start = end + 1)
+    {
+        end = block.find('\0', start);
+        const size_t separator = block.find('=', start);
+        if (separator > end)
+            continue;
+        const char *name = block.data() + start;
+        const size_t nameLength = separator - start;
+        if (block.compare(start, nameLength, "SCRIPT_FILENAME") == 0)
+            appendPair(params, name, nameLength, scriptPath.data(), scriptPath.size());
+        else
+            appendPair(params, name, nameLength, name + nameLength + 1, end - separator - 1);
+    }
+    queue(FCGI_PARAMS, id, params.data(), params.size());
+    queue(FCGI_PARAMS, id, NULL, 0);
+}
+
+/**
+ * @brief Writes as many of the queued records as the socket takes without blocking
+ *
+ * @return false if the connection failed
+ */
+bool FastCGIConnection::flush()
+{
+    if (_connecting)
+        return true;
+    while (_outStart < _out.size())
+    {
+        ssize_t bytesWritten = write(_fd, _out.data() + _outStart, _out.size() - _outStart);
+        if (bytesWritten == -1)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        _outStart += bytesWritten;
+    }
+    _out.clear();
+    _outStart = 0;
+    return true;
+}
+
+/**
+ * @brief Reads what the application sent and hands every complete record to its request
+ *
+ * @return false if the application closed the connection or it failed
+ */
+bool FastCGIConnection::receive()
+{
+    char buf[CGI_READ_SIZE];
+    ssize_t bytesRead = -1;
+    size_t pos = 0;
+
+    while (!backedUp() && (bytesRead = read(_fd, buf, sizeof(buf))) != 0)
+    {
+        if (bytesRead == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+            break;
+        }
+        _in.append(buf, bytesRead);
+        while (_in.size() - pos >= FASTCGI_RECORD)
+        {
+            const unsigned char *header = reinterpret_cast<const unsigned char *>(&_in[pos]);
+            const size_t contentLength = (header[4] << 8) | header[5];
+            const size_t recordLength = FASTCGI_RECORD + contentLength + header[6];
+            if (_in.size() - pos < recordLength)
+                break;
+            dispatch(header[1], (header[2] << 8) | header[3], &_in[pos + FASTCGI_RECORD],
+                     contentLength);
+            pos += recordLength;
+        }
+        _in.erase(0, pos);
+        pos = 0;
+    }
+    return bytesRead != 0;
+}
+
+void FastCGIConnection::dispatch(unsigned char type, unsigned short id, const char *content,
+                                 size_t len)
+{
+    if (type == FCGI_GET_VALUES_RESULT)
+        return readValues(content, len);
+    std::map<unsigned short, FastCGIRequest *>::iterator it = requests.find(id);
+    if (it == requests.end())
+        return;
+    if (type == FCGI_STDOUT && it->second != NULL)
+        it->second->addOutput(content, len);
+    else if (type == FCGI_STDERR && len != 0)
+        Log(WARN) << "FastCGI request " << id << ": " << std::string(content, len) << std::endl;
+    else if (type == FCGI_END_REQUEST)
+    {
+        if (len >= 5 && content[4] != FCGI_REQUEST_COMPLETE)
+            Log(ERR) << "FastCGI application refused request " << id << " (status "
+                     << static_cast<int>(content[4]) << ")" << std::endl;
+        if (it->second != NULL)
+            it->second->end();
+        requests.erase(it);
+    }
+}
+
+/**
+ * @brief Reads the answer to the FCGI_GET_VALUES record sent when the connection was opened
+ */
+void FastCGIConnection::readValues(const char *content, size_t len)
+{
+    const unsigned char *pos = reinterpret_cast<const unsigned char *>(content);
+    const unsigned char *end = pos + len;
+    size_t nameLength;
+    size_t valueLength;
+
+    while (readLength(pos, end, nameLength) && readLength(pos, end, valueLength) &&
+           static_cast<size_t>(end - pos) >= nameLength + valueLength)
+    {
+        const std::string name(reinterpret_cast<const char *>(pos), nameLength);
+        const std::string value(reinterpret_cast<const char *>(pos) + nameLength, valueLength);
+        if (name == FCGI_MPXS_CONNS)
+            multiplexes = value == "1";
+        pos += nameLength + valueLength;
+    }
+}
+
+/**
+ * @brief Checks the result of a non-blocking connect() once the socket is writable
+ *
+ * @return false if the connection could not be made
+ */
+bool FastCGIConnection::finishConnect()
+{
+    int error = 0;
+    socklen_t length = sizeof(error);
+
+    if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1)
+        error = errno;
+    if (error != 0)
+    {
+        Log(ERR) << "FastCGI connect: " << strerror(error) << std::endl;
+        return false;
+    }
+    _connecting = false;
+    return true;
+}
+
+/* ------------------------------------------------------------------------------------------ */
+/*                                       FastCGIRequest                                       */
+/* ------------------------------------------------------------------------------------------ */
+
+/**
+ * @brief Sends a request to the application: its role, its CGI environment and the part of the
+ * body received so far
+ */
+FastCGIRequest::FastCGIRequest(FastCGIConnection &connection, Request &request,
+                               const CGIEnvironment &env)
+    : CGIBackend(request), _connection(&connection), _id(connection.reserveId()), _output(),
+      _outputStart(0), _ended(false)
+{
+    const char begin[FASTCGI_RECORD] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+    char path[PATH_MAX];
+
+    connection.requests[_id] = this;
+    connection.queue(FCGI_BEGIN_REQUEST, _id, begin, sizeof(begin));
+    if (realpath(request.resource().path.c_str(), path) == NULL)
+        connection.queueParams(_id, env, request.resource().path);
+    else
+        connection.queueParams(_id, env, path);
+    sendBody(request.buffer() + request.bodyStart(), request.length() - request.bodyStart());
+    connection.flush();
+}
+
+FastCGIRequest::~FastCGIRequest()
+{
+    abort();
+}
+
+/**
+ * @brief Queues body bytes as FCGI_STDIN records, and the empty record that ends the body once
+ * the client has sent all of it
+ */
+void FastCGIRequest::sendBody(const char *data, size_t len)
+{
+    if (len != 0)
+        _connection->queue(FCGI_STDIN, _id, data, len);
+    if (_bodyLeft == 0)
+        _connection->queue(FCGI_STDIN, _id, NULL, 0);
+}
+
+/**
+ * @brief Tells the application the output is not needed anymore. The id stays taken until the
+ * application ends the request
+ */
+void FastCGIRequest::abort()
+{
+    if (_connection == NULL)
+        return;
+    _connection->requests[_id] = NULL;
+    _connection->queue(FCGI_ABORT_REQUEST, _id, NULL, 0);
+    _connection->flush();
+    _connection = NULL;
+    _ended = true;
+}
+
+/**
+ * @brief The application's connection is polled by FastCGIClient, so the request has nothing of
+ * its own to wait on
+ */
+void FastCGIRequest::addPollFds(std::vector<pollfd> &fds, bool wantOutput) const
+{
+    (void)fds;
+    (void)wantOutput;
+}
+
+/**
+ * @brief Passes body bytes received from the client to the application
+ *
+ * @return size_t How many of the bytes belong to the body, the rest start the next request
+ */
+size_t FastCGIRequest::feed(const char *data, size_t len)
+{
+    if (len > _bodyLeft)
+        len = _bodyLeft;
+    _bodyLeft -= len;
+    touch();
+    if (_connection == NULL)
+        return len;   // the request ended, the rest of the body is dropped
+    sendBody(data, len);
+    _connection->flush();
+    return len;
+}
+
+bool FastCGIRequest::inputFull() const
+{
+    return _connection != NULL && _connection->pending() >= CGI_INPUT_MAX;
+}
+
+void FastCGIRequest::writeInput()
+{
+    if (_connection != NULL)
+        _connection->flush();
+}
+
+/**
+ * @brief Takes FCGI_STDOUT content received so far
+ *
+ * @return ssize_t Bytes read, 0 at the end of the output, -1 if nothing is available yet
+ */
+ssize_t FastCGIRequest::readOutput(char *buf, size_t size)
+{
+    const size_t available = _output.size() - _outputStart;
+
+    if (available == 0)
+        return _ended ? 0 : -1;
+    size = std::min(size, available);
+    memcpy(buf, _output.data() + _outputStart, size);
+    _outputStart += size;
+    if (_outputStart == _output.size())
+    {
+        _output.clear();
+        _outputStart = 0;
+    }
+    return size;
+}
+
+void FastCGIRequest::terminate()
+{
+    abort();
+}
+
+size_t FastCGIRequest::buffered() const
+{
+    return _output.size() - _outputStart;
+}
+
+void FastCGIRequest::addOutput(const char *data, size_t len)
+{
+    _output.append(data, len);
+    touch();
+}
+
+/**
+ * @brief Called when the application sends FCGI_END_REQUEST, the output is complete
+ */
+void FastCGIRequest::end()
+{
+    _connection = NULL;
+    _ended = true;
+    touch();
+}
+
+/**
+ * @brief Called when the connection closes before the request ended. Without its headers the
+ * response becomes a 502, and after them the client's connection is closed
+ */
+void FastCGIRequest::connectionLost()
+{
+    Log(ERR) << "FastCGI connection closed during request " << _id << std::endl;
+    _connection = NULL;
+    _ended = true;
+    if (streaming)
+        failed = true;
+}
+
+/* ------------------------------------------------------------------------------------------ */
+/*                                        FastCGIClient                                       */
+/* ------------------------------------------------------------------------------------------ */
+
+/**
+ * @brief Resolves a fastcgi_pass address, "unix:" followed by a socket path or a host and port.
+ * The result is kept for the next requests
+ *
+ * @return FastCGIUpstream* NULL if the address can not be resolved
+ */
+FastCGIUpstream *FastCGIClient::findUpstream(const std::string &address)
+{
+    std::map<std::string, FastCGIUpstream>::iterator it = upstreams.find(address);
+    FastCGIUpstream upstream;
+
+    if (it != upstreams.end())
+        return &it->second;
+    if (address.compare(0, 5, "pool:") == 0)
+        return NULL;   // pools are only created by startPools()
+    upstream.workers = 0;
+    upstream.maxRequests = 0;
+    memset(&upstream.address, 0, sizeof(upstream.address));
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        sockaddr_un *unixAddress = reinterpret_cast<sockaddr_un *>(&upstream.address);
+        const std::string path = address.substr(5);
+        if (path.size() >= sizeof(unixAddress->sun_path))
+            return NULL;
+        unixAddress->sun_family = AF_UNIX;
+        memcpy(unixAddress->sun_path, path.c_str(), path.size() + 1);
+        upstream.length = sizeof(sockaddr_un);
+    }
+    else
+    {
+        const size_t colon = address.rfind(':');
+        addrinfo hints;
+        addrinfo *info;
+
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        const int status = getaddrinfo(address.substr(0, colon).c_str(),
+                                       address.substr(colon + 1).c_str(), &hints, &info);
+        if (status != 0)
+        {
+            Log(ERR) << "FastCGI " << address << ": " << gai_strerror(status) << std::endl;
+            return NULL;
+        }
+        memcpy(&upstream.address, info->ai_addr, info->ai_addrlen);
+        upstream.length = info->ai_addrlen;
+        freeaddrinfo(info);
+    }
+    return &(upstreams[address] = upstream);
+}
+
+/**
+ * @brief Opens a new connection to the application without waiting for it to be accepted
+ *
+ * @return FastCGIConnection* NULL if the connection failed right away
+ */
+FastCGIConnection *FastCGIClient::connect(FastCGIUpstream &upstream)
+{
+    const int fd = socket(upstream.address.ss_family, SOCK_STREAM, 0);
+
+    if (fd == -1)
+    {
+        Log(ERR) << "FastCGI socket: " << strerror(errno) << std::endl;
+        return NULL;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    bool connecting = false;
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&upstream.address), upstream.length) == -1)
+    {
+        if (errno != EINPROGRESS)
+        {
+            Log(ERR) << "FastCGI connect: " << strerror(errno) << std::endl;
+            ::close(fd);
+            return NULL;
+        }
+        connecting = true;
+    }
+    FastCGIConnection *connection = new FastCGIConnection(upstream, fd, connecting);
+    upstream.connections.push_back(connection);
+    connections[fd] = connection;
+    return connection;
+}
+
+/**
+ * @brief Starts a cgi_pool worker connected to one end of a socket pair
+ *
+ * @return FastCGIConnection* NULL if the worker could not be started
+ */
+FastCGIConnection *FastCGIClient::spawnWorker(FastCGIUpstream &pool)
+{
+    int ends[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) == -1)
+    {
+        Log(ERR) << "CGI pool socketpair: " << strerror(errno) << std::endl;
+        return NULL;
+    }
+    fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ends[1], F_SETFD, FD_CLOEXEC);
+    char *const args[] = {const_cast<char *>(pool.program.c_str()), NULL};
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, ends[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, ends[1], STDOUT_FILENO);
+    const int error = posix_spawn(&pid, args[0], &actions, NULL, args, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(ends[1]);
+    if (error != 0)
+    {
+        Log(ERR) << "CGI pool posix_spawn " << pool.program << ": " << strerror(error)
+                 << std::endl;
+        ::close(ends[0]);
+        return NULL;
+    }
+    fcntl(ends[0], F_SETFL, O_NONBLOCK);
+    FastCGIConnection *connection = new FastCGIConnection(pool, ends[0], false);
+    connection->worker = pid;
+    pool.connections.push_back(connection);
+    connections[ends[0]] = connection;
+    Log(INFO) << "Started CGI worker " << pid << " for " << pool.program << std::endl;
+    return connection;
+}
+
+/**
+ * @brief Picks the connection for a new request: an idle one that is still open, else one that
+ * multiplexes and has room for another request, else a new one. A busy pool queues the request
+ * on the worker with the fewest requests, which handles it after the ones before it
+ */
+FastCGIConnection *FastCGIClient::pickConnection(FastCGIUpstream &upstream)
+{
+    const bool pool = !upstream.program.empty();
+    FastCGIConnection *shared = NULL;
+
+    for (size_t i = upstream.connections.size(); i-- > 0;)
+    {
+        FastCGIConnection *connection = upstream.connections[i];
+        if (connection->retired())
+            continue;
+        if (connection->requests.empty())
+        {
+            pollfd fd = {connection->fd(), POLLIN, 0};
+            // the application may have closed it since the last poll()
+            if (poll(&fd, 1, 0) == 0 || connection->receive())
+                return connection;
+            close(connection);
+        }
+        else if (pool && (shared == NULL ||
+                          connection->requests.size() < shared->requests.size()))
+            shared = connection;
+        else if (!pool && shared == NULL && connection->multiplexes &&
+                 connection->requests.size() < FASTCGI_MPX_MAX)
+            shared = connection;
+    }
+    if (shared != NULL)
+        return shared;
+    return pool ? spawnWorker(upstream) : connect(upstream);
+}
+
+void FastCGIClient::close(FastCGIConnection *connection)
+{
+    std::vector<FastCGIConnection *> &siblings = connection->upstream.connections;
+
+    if (connection->worker != -1 && !connection->retired())
+        Log(WARN) << "CGI worker " << connection->worker << " exited" << std::endl;
+
+    connections.erase(connection->fd());
+    siblings.erase(std::find(siblings.begin(), siblings.end(), connection));
+    delete connection;
+}
+
+/**
+ * @brief The key of the application that runs a location's CGI files: its fastcgi_pass address,
+ * or its cgi_pool line. Locations with the same cgi_pool line share its workers
+ *
+ * @return std::string Empty if the location forks its CGI scripts
+ */
+std::string FastCGIClient::upstreamOf(const Route &route)
+{
+    if (!route.fastcgiPass.empty())
+        return route.fastcgiPass;
+    if (route.cgiPool.empty())
+        return "";
+    return "pool:" + route.cgiPool + " workers=" + toStr(route.cgiPoolWorkers) +
+           " requests=" + toStr(route.cgiPoolRequests);
+}
+
+/**
+ * @brief Starts the workers of every cgi_pool in the config, so the first requests do not wait
+ * for an interpreter to start
+ */
+void FastCGIClient::startPools(serverList servers)
+{
+    for (size_t i = 0; i < servers.size(); i++)
+    {
+        for (std::map<std::string, Route>::const_iterator it = servers[i].routes.begin();
+             it != servers[i].routes.end(); it++)
+        {
+            const std::string key = upstreamOf(it->second);
+            if (it->second.cgiPool.empty() || upstreams.count(key))
+                continue;
+            FastCGIUpstream &pool = upstreams[key];
+            memset(&pool.address, 0, sizeof(pool.address));
+            pool.length = 0;
+            pool.program = it->second.cgiPool;
+            pool.workers = it->second.cgiPoolWorkers;
+            pool.maxRequests = it->second.cgiPoolRequests;
+        }
+    }
+    maintainPools();
+}
+
+/**
+ * @brief Replaces the workers that exited or were retired, called once a second
+ */
+void FastCGIClient::maintainPools()
+{
+    for (std::map<std::string, FastCGIUpstream>::iterator it = upstreams.begin();
+         it != upstreams.end(); it++)
+    {
+        FastCGIUpstream &pool = it->second;
+        size_t active = 0;
+
+        if (pool.program.empty())
+            continue;
+        for (size_t i = 0; i < pool.connections.size(); i++)
+            active += !pool.connections[i]->retired();
+        for (; active < pool.workers; active++)
+            if (spawnWorker(pool) == NULL)
+                break;
+    }
+}
+
+/**
+ * @brief Starts a request on the application at the given fastcgi_pass address, or on a worker
+ * of the given pool
+ *
+ * @return CGIHandle Empty if the application can not be reached
+ */
+CGIHandle FastCGIClient::start(const std::string &address, Request &request,
+                               const CGIEnvironment &env)
+{
+    FastCGIUpstream *upstream = findUpstream(address);
+    FastCGIConnection *connection = upstream != NULL ? pickConnection(*upstream) : NULL;
+
+    if (connection == NULL)
+        return CGIHandle();
+    connection->served++;
+    return CGIHandle(new FastCGIRequest(*connection, request, env));
+}
+
+/**
+ * @brief Adds every connection to the descriptors of the next poll()
+ */
+void FastCGIClient::addPollFds(std::vector<pollfd> &fds)
+{
+    pollStart = fds.size();
+    pollCount = connections.size();
+    for (std::map<int, FastCGIConnection *>::iterator it = connections.begin();
+         it != connections.end(); it++)
+    {
+        pollfd fd = {it->first, it->second->pollEvents(), 0};
+        fds.push_back(fd);
+    }
+}
+
+/**
+ * @brief Handles the connections poll() reported on: completes connects, writes queued records
+ * and reads records into their requests. Connections that failed are closed, and so are idle
+ * ones beyond FASTCGI_IDLE_MAX
+ */
+void FastCGIClient::update(const std::vector<pollfd> &fds)
+{
+    for (size_t i = pollStart; i < pollStart + pollCount && i < fds.size(); i++)
+    {
+        std::map<int, FastCGIConnection *>::iterator it = connections.find(fds[i].fd);
+        if (fds[i].revents == 0 || it == connections.end())
+            continue;
+        FastCGIConnection *connection = it->second;
+        bool open = !connection->connecting() || connection->finishConnect();
+        if (open && (fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            open = connection->receive();
+        if (open)
+            open = connection->flush();
+        if (open && connection->requests.empty() && connection->retired())
+        {
+            Log(DBUG) << "Replacing CGI worker " << connection->worker << " after "
+                      << connection->served << " requests" << std::endl;
+            open = false;
+        }
+        else if (open && connection->requests.empty() && connection->upstream.program.empty())
+        {
+            size_t idle = 0;
+            for (size_t j = 0; j < connection->upstream.connections.size(); j++)
+                idle += connection->upstream.connections[j]->requests.empty();
+            open = idle <= FASTCGI_IDLE_MAX;
+        }
+        if (open)
+            continue;
+        FastCGIUpstream &upstream = connection->upstream;
+        const bool retired = connection->retired();
+        close(connection);
+        // workers that crash are replaced by maintainPools(), so a broken one is not restarted
+        // in a loop
+        if (retired)
+            spawnWorker(upstream);
+    }
+}
@@ -0,0 +1,229 @@
+/**
+ * @file FileCache.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of the open file descriptor cache
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/FileCache.hpp"
+#include "logger/Logger.hpp"
+#include "responses/HeaderData.hpp"
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using logger::Log;
+
+size_t OpenFile::openCount = 0;
+
+std::map<std::string, FileCache> FileCache::caches = std::map<std::string, FileCache>();
+
+OpenFile::OpenFile() : fd(-1), size(0), mtime(0), inode(0), device(0), mimeType()
+{
+}
+
+OpenFile::~OpenFile()
+{
+    if (fd == -1)
+        return;
+    close(fd);
+    openCount--;
+}
+
+FileCache::FileCache() : _entries(), _lru(), _missing(), _maxEntries(0), _validSecs(0)
+{
+}
+
+void FileCache::configure(size_t maxEntries, time_t validSecs)
+{
+    _maxEntries = maxEntries;
+    _validSecs = validSecs;
+}
+
+/**
+ * @brief The number of descriptors all caches together may keep open. Leaves FD_RESERVE
+ * descriptors below RLIMIT_NOFILE for everything else the server needs
+ *
+ * @return size_t Maximum number of cached descriptors
+ */
+size_t FileCache::fdBudget()
+{
+    static size_t budget = 0;
+    struct rlimit limit;
+
+    if (budget != 0)
+        return budget;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur == RLIM_INFINITY)
+        limit.rlim_cur = 1024;
+    if (limit.rlim_cur > 2 * FD_RESERVE)
+        budget = limit.rlim_cur - FD_RESERVE;
+    else
+        budget = limit.rlim_cur / 2;
+    return budget;
+}
+
+/**
+ * @brief Opens a regular file and records its metadata
+ *
+ * @param path Path to the file
+ * @return FileHandle Handle to the opened file, null if it is missing or not a regular file
+ */
+FileHandle FileCache::openUncached(const std::string &path)
+{
+    struct stat info;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return FileHandle();
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return FileHandle();
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    OpenFile *file = new OpenFile;
+    file->fd = fd;
+    file->size = info.st_size;
+    file->mtime = info.st_mtime;
+    file->inode = info.st_ino;
+    file->device = info.st_dev;
+    file->mimeType = getContentType(path);
+    OpenFile::openCount++;
+    return FileHandle(file);
+}
+
+void FileCache::evict(std::map<std::string, Entry>::iterator entry)
+{
+    // Responses still sending this file keep their own handle, the fd is closed after them
+    _lru.erase(entry->second.lruPos);
+    _entries.erase(entry);
+}
+
+bool FileCache::evictOldest()
+{
+    if (_lru.empty())
+        return false;
+    evict(_entries.find(_lru.back()));
+    return true;
+}
+
+/**
+ * @brief Checks if a cached file still refers to what is on disk. Only stats the file once
+ * every `valid` seconds
+ */
+bool FileCache::stillValid(Entry &entry, time_t now)
+{
+    struct stat info;
+
+    if (now - entry.validated < _validSecs)
+        return true;
+    const std::string &path = *entry.lruPos;
+    if (stat(path.c_str(), &info) == -1)
+        return false;
+    const OpenFile &file = *entry.file;
+    if (info.st_ino != file.inode || info.st_dev != file.device || info.st_mtime != file.mtime ||
+        info.st_size != file.size)
+        return false;
+    entry.validated = now;
+    return true;
+}
+
+FileHandle FileCache::open(const std::string &path, bool rememberMissing)
+{
+    const time_t now = time(NULL);
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+
+    if (rememberMissing)
+    {
+        std::map<std::string, time_t>::iterator missing = _missing.find(path);
+        if (missing != _missing.end() && now - missing->second < _validSecs)
+            return FileHandle();
+    }
+
+    if (it != _entries.end())
+    {
+        if (stillValid(it->second, now))
+        {
+            _lru.splice(_lru.begin(), _lru, it->second.lruPos);
+            return it->second.file;
+        }
+        Log(DBUG) << "Open file cache: " << path << " changed on disk" << std::endl;
+        evict(it);
+    }
+
+    FileHandle file = openUncached(path);
+    if (file.isNull())
+    {
+        if (rememberMissing)
+        {
+            if (_missing.size() >= _maxEntries)
+                _missing.clear();
+            _missing[path] = now;
+        }
+        return file;
+    }
+    _missing.erase(path);
+
+    // Make room, dropping our own oldest entries when the process wide fd budget is used up
+    while (_entries.size() >= _maxEntries || OpenFile::openCount > fdBudget())
+        if (!evictOldest())
+            return file;   // nothing left to evict here, serve this one uncached
+
+    Entry &entry = _entries[path];
+    entry.file = file;
+    entry.validated = now;
+    _lru.push_front(path);
+    entry.lruPos = _lru.begin();
+    return file;
+}
+
+void FileCache::invalidate(const std::string &path)
+{
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end())
+        evict(it);
+    _missing.erase(path);
+}
+
+size_t FileCache::size() const
+{
+    return _entries.size();
+}
+
+void FileCache::clear()
+{
+    _entries.clear();
+    _lru.clear();
+    _missing.clear();
+}
+
+FileHandle FileCache::open(const std::string &path, const Route &route, bool rememberMissing)
+{
+    if (route.openFileCacheMax == 0)
+        return openUncached(path);
+    std::map<std::string, FileCache>::iterator it = caches.find(route.serveDir);
+    // the parser makes sure every location serving this directory has the same settings
+    if (it == caches.end())
+    {
+        it = caches.insert(std::make_pair(route.serveDir, FileCache())).first;
+        it->second.configure(route.openFileCacheMax, route.openFileCacheValid);
+    }
+    return it->second.open(path, rememberMissing);
+}
+
+/**
+ * @brief Drops a file from its route's cache, used when we modify or delete the file ourselves
+ */
+void FileCache::invalidate(const std::string &path, const Route &route)
+{
+    std::map<std::string, FileCache>::iterator it = caches.find(route.serveDir);
+
+    // the file may be cached by another location serving the same directory
+    if (it != caches.end())
+        it->second.invalidate(path);
+}
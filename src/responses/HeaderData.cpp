@@ -10,21 +10,31 @@
 
 #include "responses/HeaderData.hpp"
 #include "logger/Logger.hpp"
+#include "responses/FileCache.hpp"
 #include "utils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <map>
 
-std::string getStatus(int statusCode)
+const char *getStatus(int statusCode)
 {
     switch (statusCode)
     {
     case 200:
         return "200 OK";
+    case 206:
+        return "206 Partial Content";
     case 201:
         return "201 Created";
     case 204:
         return "204 No Content";
     case 302:
         return "302 Found";
+    case 304:
+        return "304 Not Modified";
     case 307:
         return "307 Temporary Redirect";
     case 400:
@@ -37,6 +47,8 @@ std::string getStatus(int statusCode)
         return "409 Conflict";
     case 413:
         return "413 Content Too Large";
+    case 416:
+        return "416 Range Not Satisfiable";
     case 502:
         return "502 Bad Gateway";
     case 504:
@@ -62,3 +74,198 @@ std::string getContentType(std::string filename)
             return mimeTypes.at(&filename[extensionStart]);
     return "application/octet-stream";
 }
+
+/**
+ * @brief Formats the strong entity tag of a file from its inode, size and modification time, so
+ * it changes whenever the file is modified or replaced
+ *
+ * @param buffer At least ETAG_MAX bytes
+ * @return size_t Length of the tag, quotes included
+ */
+size_t formatETag(const OpenFile &file, char *buffer)
+{
+    return snprintf(buffer, ETAG_MAX, "\"%lx-%lx-%lx\"", static_cast<unsigned long>(file.inode),
+                    static_cast<unsigned long>(file.size), static_cast<unsigned long>(file.mtime));
+}
+
+/**
+ * @brief Formats a time as an HTTP date, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+ *
+ * @param buffer At least HTTP_DATE_MAX bytes
+ * @return size_t Length of the date
+ */
+size_t formatHTTPDate(time_t date, char *buffer)
+{
+    return strftime(buffer, HTTP_DATE_MAX, "%a, %d %b %Y %H:%M:%S GMT", gmtime(&date));
+}
+
+/**
+ * @brief Parses an HTTP date in the preferred IMF-fixdate format
+ *
+ * @return time_t The time, or -1 if the date is invalid
+ */
+time_t parseHTTPDate(const std::string &date)
+{
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0')
+        return -1;
+    return timegm(&tm);
+}
+
+/**
+ * @brief Checks if an If-None-Match list contains an entity tag, using the weak comparison
+ * required for conditional GET
+ */
+bool etagListMatches(const std::string &list, const char *etag, size_t etagLen)
+{
+    size_t start = 0;
+
+    while (start < list.length())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.length();
+        std::string tag = list.substr(start, end - start);
+        trimStr(tag, WHITESPACE);
+        if (tag == "*")
+            return true;
+        if (tag.compare(0, 2, "W/") == 0)
+            tag.erase(0, 2);
+        if (tag.length() == etagLen && tag.compare(0, etagLen, etag, etagLen) == 0)
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief Parses a byte offset in a range spec
+ *
+ * @return off_t The offset, or -1 if it is not a number or too big
+ */
+static off_t parseOffset(const std::string &str)
+{
+    off_t offset = 0;
+
+    if (str.empty() || str.length() > 18)
+        return -1;
+    for (size_t i = 0; i < str.length(); i++)
+    {
+        if (!isdigit(str[i]))
+            return -1;
+        offset = offset * 10 + (str[i] - '0');
+    }
+    return offset;
+}
+
+/**
+ * @brief Parses the value of a Range header, e.g. "bytes=0-499, 1000-, -200", into half-open
+ * ranges clamped to the size of the file. Ranges starting past the end of the file are dropped
+ *
+ * @return int RANGE_SATISFIABLE, RANGE_UNSATISFIABLE if no range overlaps the file, or
+ * RANGE_IGNORED if the header is malformed or has too many ranges
+ */
+int parseRanges(const std::string &value, off_t size, std::vector<ByteRange> &ranges)
+{
+    size_t specCount = 0;
+    size_t start = 6;
+
+    if (value.compare(0, 6, "bytes=") != 0)
+        return RANGE_IGNORED;
+    while (start <= value.length())
+    {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos)
+            end = value.length();
+        std::string spec = value.substr(start, end - start);
+        start = end + 1;
+        trimStr(spec, WHITESPACE);
+        if (spec.empty())
+            continue;
+        if (++specCount > RANGES_MAX)
+            return RANGE_IGNORED;
+        size_t dash = spec.find('-');
+        if (dash == std::string::npos)
+            return RANGE_IGNORED;
+        const bool suffix = dash == 0;
+        const bool openEnded = dash == spec.length() - 1;
+        off_t first = suffix ? 0 : parseOffset(spec.substr(0, dash));
+        off_t last = openEnded ? size : parseOffset(spec.substr(dash + 1));
+        if (first == -1 || last == -1 || (suffix && openEnded))
+            return RANGE_IGNORED;
+
+        ByteRange range;
+        if (suffix)   // the last `last` bytes
+        {
+            range.start = last >= size ? 0 : size - last;
+            range.end = size;
+        }
+        else
+        {
+            if (!openEnded && last < first)
+                return RANGE_IGNORED;
+            range.start = first;
+            range.end = last >= size ? size : last + 1;
+        }
+        if (range.start < range.end)
+            ranges.push_back(range);
+    }
+    if (specCount == 0)
+        return RANGE_IGNORED;
+    return ranges.empty() ? RANGE_UNSATISFIABLE : RANGE_SATISFIABLE;
+}
+
+/**
+ * @brief Formats the value of a Content-Range header, or the unsatisfied-range form with only
+ * the file size if range is NULL
+ *
+ * @param buffer At least CONTENT_RANGE_MAX bytes
+ * @return size_t Length of the value
+ */
+size_t formatContentRange(const ByteRange *range, off_t size, char *buffer)
+{
+    if (range == NULL)
+        return snprintf(buffer, CONTENT_RANGE_MAX, "bytes */%lu", static_cast<unsigned long>(size));
+    return snprintf(buffer, CONTENT_RANGE_MAX, "bytes %lu-%lu/%lu",
+                    static_cast<unsigned long>(range->start),
+                    static_cast<unsigned long>(range->end - 1), static_cast<unsigned long>(size));
+}
+
+/**
+ * @brief Checks if an Accept-Encoding list allows a content coding, by name or through "*".
+ * Codings listed with q=0 are refused
+ */
+bool acceptsEncoding(const std::string &list, const std::string &coding)
+{
+    size_t start = 0;
+    bool starAccepted = false;
+
+    while (start < list.length())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.length();
+        std::string item = list.substr(start, end - start);
+        start = end + 1;
+
+        size_t params = item.find(';');
+        std::string name = item.substr(0, params);
+        trimStr(name, WHITESPACE);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        bool accepted = true;
+        if (params != std::string::npos)
+        {
+            size_t q = item.find("q=", params);
+            if (q != std::string::npos)
+                accepted = strtod(item.c_str() + q + 2, NULL) > 0;
+        }
+        if (name == coding)
+            return accepted;
+        if (name == "*")
+            starAccepted = accepted;
+    }
+    return starAccepted;
+}
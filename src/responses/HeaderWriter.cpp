@@ -0,0 +1,218 @@
+/**
+ * @file HeaderWriter.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of the response head writer
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/HeaderWriter.hpp"
+#include "responses/HeaderData.hpp"
+#include <cstring>
+
+#define STRLEN(literal) (sizeof(literal) - 1)
+
+static const char serverLine[] = "Server: " SERVER_SOFTWARE "\r\n";
+
+char HeaderWriter::dateLine[64];
+size_t HeaderWriter::dateLineLen = 0;
+time_t HeaderWriter::dateTime = 0;
+char HeaderWriter::expiresLine[64];
+size_t HeaderWriter::expiresLineLen = 0;
+time_t HeaderWriter::expiresTime = 0;
+
+HeaderWriter::HeaderWriter() : _length(0), _preambleEnd(0)
+{
+}
+
+HeaderWriter::HeaderWriter(const HeaderWriter &w)
+    : _length(w._length), _preambleEnd(w._preambleEnd), _overflow(w._overflow)
+{
+    if (_overflow.empty())
+        memcpy(_buffer, w._buffer, w._length);
+}
+
+HeaderWriter &HeaderWriter::operator=(const HeaderWriter &w)
+{
+    if (this != &w)
+    {
+        if (w._overflow.empty())
+            memcpy(_buffer, w._buffer, w._length);
+        _length = w._length;
+        _preambleEnd = w._preambleEnd;
+        _overflow = w._overflow;
+    }
+    return *this;
+}
+
+const char *HeaderWriter::data() const
+{
+    return _overflow.empty() ? _buffer : _overflow.data();
+}
+
+size_t HeaderWriter::length() const
+{
+    return _length;
+}
+
+/**
+ * @brief End of the status and Date lines. Everything after it is the same for every response
+ * to an unchanged resource and can be cached
+ */
+size_t HeaderWriter::preambleEnd() const
+{
+    return _preambleEnd;
+}
+
+void HeaderWriter::reset()
+{
+    _length = 0;
+    _preambleEnd = 0;
+    _overflow.clear();
+}
+
+/**
+ * @brief Appends to the inline buffer, or to the heap once the head no longer fits in it, e.g.
+ * for a Location holding a very long URL
+ */
+void HeaderWriter::append(const char *str, size_t len)
+{
+    if (_overflow.empty() && _length + len <= HEADER_MAX)
+        memcpy(_buffer + _length, str, len);
+    else
+    {
+        if (_overflow.empty())
+            _overflow.assign(_buffer, _length);
+        _overflow.append(str, len);
+    }
+    _length += len;
+}
+
+/**
+ * @brief Starts the head with the status line and the shared Date line. An Expires line is part of
+ * the preamble too, since it moves with the date
+ *
+ * @param expires Seconds from now until the response expires, NO_EXPIRES (or any negative value)
+ * for no Expires line
+ */
+void HeaderWriter::preamble(int statusCode, long expires)
+{
+    const char *status = getStatus(statusCode);
+
+    reset();
+    append("HTTP/1.1 ", STRLEN("HTTP/1.1 "));
+    append(status, strlen(status));
+    append("\r\n", 2);
+    appendDate(expires);
+}
+
+/**
+ * @brief Appends the Date line, and the Expires line if any, ending the preamble
+ */
+void HeaderWriter::appendDate(long expires)
+{
+    if (dateLineLen == 0)
+        updateDate(time(NULL));
+    append(dateLine, dateLineLen);
+    if (expires >= 0)
+    {
+        const time_t expiresAt = dateTime + expires;
+        if (expiresAt != expiresTime || expiresLineLen == 0)
+        {
+            expiresTime = expiresAt;
+            expiresLineLen = strftime(expiresLine, sizeof(expiresLine),
+                                      "Expires: %a, %d %b %Y %H:%M:%S GMT\r\n", gmtime(&expiresAt));
+        }
+        append(expiresLine, expiresLineLen);
+    }
+    _preambleEnd = _length;
+}
+
+/**
+ * @brief Starts the head with the preamble followed by the Server line
+ */
+void HeaderWriter::statusLine(int statusCode, long expires)
+{
+    preamble(statusCode, expires);
+    append(serverLine, STRLEN(serverLine));
+}
+
+/**
+ * @brief Starts the head with a status given as text, such as the one given by a CGI script
+ *
+ * @param status The code followed by its reason phrase, e.g. "403 Forbidden"
+ */
+void HeaderWriter::statusLine(const std::string &status)
+{
+    reset();
+    append("HTTP/1.1 ", STRLEN("HTTP/1.1 "));
+    append(status.data(), status.size());
+    append("\r\n", 2);
+    appendDate(NO_EXPIRES);
+    append(serverLine, STRLEN(serverLine));
+}
+
+/**
+ * @brief Appends a complete header line, CRLF included
+ */
+void HeaderWriter::line(const char *line, size_t len)
+{
+    append(line, len);
+}
+
+void HeaderWriter::header(const char *name, const char *value)
+{
+    append(name, strlen(name));
+    append(value, strlen(value));
+    append("\r\n", 2);
+}
+
+void HeaderWriter::header(const char *name, const char *value, size_t len)
+{
+    append(name, strlen(name));
+    append(value, len);
+    append("\r\n", 2);
+}
+
+void HeaderWriter::header(const char *name, const std::string &value)
+{
+    append(name, strlen(name));
+    append(value.data(), value.length());
+    append("\r\n", 2);
+}
+
+void HeaderWriter::header(const char *name, size_t value)
+{
+    char digits[24];
+    char *start = digits + sizeof(digits);
+
+    // digits are written backwards from the end of the array
+    do
+    {
+        *--start = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    append(name, strlen(name));
+    append(start, digits + sizeof(digits) - start);
+    append("\r\n", 2);
+}
+
+void HeaderWriter::end()
+{
+    append("\r\n", 2);
+}
+
+/**
+ * @brief Regenerates the shared Date line if the second changed since the last call. Called once
+ * per event loop iteration
+ */
+void HeaderWriter::updateDate(time_t now)
+{
+    if (now == dateTime && dateLineLen != 0)
+        return;
+    dateTime = now;
+    dateLineLen = strftime(dateLine, sizeof(dateLine), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n",
+                           gmtime(&now));
+}
@@ -0,0 +1,143 @@
+/**
+ * @file MappedFile.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of shared file mappings
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/MappedFile.hpp"
+#include "logger/Logger.hpp"
+#include <cerrno>
+#include <csetjmp>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using logger::Log;
+
+std::map<std::string, MappingHandle> MappingCache::mappings =
+    std::map<std::string, MappingHandle>();
+
+static sigjmp_buf faultJump;
+static volatile sig_atomic_t guarding = 0;   // a guarded write is in progress
+
+MappedFile::MappedFile() : data(NULL), length(0), mtime(0), inode(0), device(0), faulted(false)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != NULL)
+        munmap(data, length);
+}
+
+/**
+ * @brief Forgets mappings that no response is using anymore
+ */
+void MappingCache::dropUnused()
+{
+    std::map<std::string, MappingHandle>::iterator it = mappings.begin();
+    while (it != mappings.end())
+    {
+        std::map<std::string, MappingHandle>::iterator next = it;
+        next++;
+        if (it->second.useCount() == 1)
+            mappings.erase(it);
+        it = next;
+    }
+}
+
+/**
+ * @brief Gets a mapping of an open file, reusing the mapping of an earlier download if it is
+ * still in use and the file has not changed since
+ *
+ * @param path Path to the file, used as the key
+ * @param file The opened file
+ * @return MappingHandle The mapping, null if mapping failed
+ */
+MappingHandle MappingCache::map(const std::string &path, const OpenFile &file)
+{
+    std::map<std::string, MappingHandle>::iterator it = mappings.find(path);
+    if (it != mappings.end())
+    {
+        const MappedFile &mapped = *it->second;
+        if (mapped.inode == file.inode && mapped.device == file.device &&
+            mapped.mtime == file.mtime && mapped.length == static_cast<size_t>(file.size) &&
+            !mapped.faulted)
+            return it->second;
+    }
+    dropUnused();
+
+    // the open file may be cached from before the file was truncated, map only what is there
+    struct stat info;
+    if (fstat(file.fd, &info) == -1 || info.st_size != file.size)
+        return MappingHandle();
+
+    void *data = mmap(NULL, file.size, PROT_READ, MAP_SHARED, file.fd, 0);
+    if (data == MAP_FAILED)
+    {
+        Log(WARN) << "mmap " << path << ": " << strerror(errno) << std::endl;
+        return MappingHandle();
+    }
+    // the file is read front to back, so ask the kernel for aggressive readahead
+    madvise(data, file.size, MADV_SEQUENTIAL);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(file.fd, 0, file.size, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(file.fd, 0, file.size, POSIX_FADV_WILLNEED);
+#endif
+
+    MappedFile *mapped = new MappedFile;
+    mapped->data = static_cast<char *>(data);
+    mapped->length = file.size;
+    mapped->mtime = file.mtime;
+    mapped->inode = file.inode;
+    mapped->device = file.device;
+    MappingHandle handle(mapped);
+    mappings[path] = handle;
+    return handle;
+}
+
+/**
+ * @brief Reached when a guarded write touches a page of a mapping past the end of its truncated
+ * file. Outside of a guarded write, it is a real bus error
+ */
+static void sigBusHandler(int sig)
+{
+    if (guarding)
+        siglongjmp(faultJump, 1);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/**
+ * @brief writev() for buffers that point into mappings. If another process truncates a mapped
+ * file, the pages past its new end are gone: Linux fails the write with EFAULT, other systems
+ * may raise SIGBUS instead, which would kill the server. Both are reported as EFAULT
+ *
+ * @return ssize_t Bytes written, or -1 on failure
+ */
+ssize_t MappingCache::guardedWritev(int fd, const struct iovec *iov, int count)
+{
+    static bool handlerSet = false;
+
+    if (!handlerSet)
+    {
+        signal(SIGBUS, sigBusHandler);
+        handlerSet = true;
+    }
+    if (sigsetjmp(faultJump, 1) != 0)
+    {
+        guarding = 0;
+        errno = EFAULT;
+        return -1;
+    }
+    guarding = 1;
+    const ssize_t bytesWritten = writev(fd, iov, count);
+    guarding = 0;
+    return bytesWritten;
+}
@@ -12,59 +12,91 @@
 #include "cgiUtils.hpp"
 #include "logger/Logger.hpp"
 #include "network/SystemCallException.hpp"
+#include "responses/CGICache.hpp"
+#include "responses/CGIQueue.hpp"
+#include "responses/Compression.hpp"
 #include "responses/DefaultPages.hpp"
+#include "responses/DirectoryListing.hpp"
+#include "responses/ErrorPages.hpp"
+#include "responses/FastCGI.hpp"
 #include "utils.hpp"
 #include <algorithm>
+#include <cctype>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
 #include <libgen.h>
+#include <sstream>
+#include <strings.h>
 #include <sys/fcntl.h>
 #include <sys/poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 #define WRITE_MAX     65536
 #define READ_MAX      1024
 #define WRITE_SIZE(x) (x <= WRITE_MAX ? x : WRITE_MAX)
+#define SENDFILE_MAX  1048576   // max bytes sent per sendResponse() call so one download
+                                // cannot hog the event loop
+#define IOV_BATCH     16        // max segments gathered into one writev()
+#define CHUNK_PREFIX  18        // room for the hex size line in front of a streamed chunk
+#define LAST_CHUNK    "0\r\n\r\n"
+#define STREAM_MIN    2048      // listings with more entries are streamed
 
-Response::Response() : _buffer(NULL), _length(0), _totalBytesSent(0), _statusCode(0)
+Segment::Segment() : head(false), buffer(), mapping(), file(), pipe(-1), offset(0), end(0)
+{
+}
+
+const char *Segment::data() const
+{
+    if (!buffer.isNull())
+        return buffer->data();
+    return mapping->data;
+}
+
+bool Segment::inMemory() const
+{
+    return file.isNull() && pipe == -1;
+}
+
+Response::Response()
+    : _head(), _segments(), _current(0), _length(0), _totalBytesSent(0), _statusCode(0),
+      _htmlCompressLevel(0), _htmlCompressMinLength(0), _stream(), _cgi()
 {
 }
 
 Response::Response(const Response &r)
-    : _buffer(NULL), _length(r._length), _totalBytesSent(r._totalBytesSent),
-      _statusCode(r._statusCode)
+    : _head(r._head), _segments(r._segments), _current(r._current), _length(r._length),
+      _totalBytesSent(r._totalBytesSent), _statusCode(r._statusCode),
+      _htmlCompressLevel(r._htmlCompressLevel), _htmlCompressMinLength(r._htmlCompressMinLength),
+      _stream(r._stream), _cgi(r._cgi)
 {
-    if (this->_buffer != NULL)
-        delete[] _buffer;
-    this->_buffer = new char[r._length];
-    for (size_t i = 0; i < r._length; i++)
-        this->_buffer[i] = r._buffer[i];
 }
 
 Response &Response::operator=(const Response &r)
 {
     if (this != &r)
     {
-        if (this->_buffer != NULL)
-            delete[] _buffer;
-        this->_buffer = new char[r._length];
-        for (size_t i = 0; i < r._length; i++)
-            this->_buffer[i] = r._buffer[i];
+        this->_head = r._head;
+        this->_segments = r._segments;
+        this->_current = r._current;
         this->_length = r._length;
         this->_totalBytesSent = r._totalBytesSent;
         this->_statusCode = r._statusCode;
+        this->_htmlCompressLevel = r._htmlCompressLevel;
+        this->_htmlCompressMinLength = r._htmlCompressMinLength;
+        this->_stream = r._stream;
+        this->_cgi = r._cgi;
     }
     return (*this);
 }
 
-char *Response::buffer()
-{
-    return _buffer;
-}
-
 size_t Response::length()
 {
     return _length;
@@ -82,93 +114,387 @@ int Response::statusCode()
 
 void Response::clear()
 {
-    if (_buffer != NULL)
-        delete[] _buffer;
-    _buffer = NULL;
+    _segments.clear();
+    _current = 0;
     _length = 0;
     _totalBytesSent = 0;
     _statusCode = 0;
+    _stream.reset();
 }
 
-int Response::sendResponse(int fd)
+void Response::addSegment(const Segment &segment)
 {
-    ssize_t bytesSent;
+    if (segment.offset >= segment.end)
+        return;
+    _segments.push_back(segment);
+    _length += segment.end - segment.offset;
+}
 
-    if (_length == 0)
-        return IDLE_CONNECTION;
-    Log(INFO) << "Sending a response... " << std::endl;
-    bytesSent = send(fd, _buffer + _totalBytesSent, _length - _totalBytesSent, 0);
-    if (bytesSent < 0)
+/**
+ * @brief Starts the response with the head formatted in _head
+ */
+void Response::addHead()
+{
+    Segment segment;
+
+    clear();
+    segment.head = true;
+    segment.end = _head.length();
+    addSegment(segment);
+}
+
+void Response::addBuffer(const BufferHandle &buffer)
+{
+    Segment segment;
+
+    segment.buffer = buffer;
+    segment.end = buffer->size();
+    addSegment(segment);
+}
+
+void Response::addMapping(const MappingHandle &mapping, off_t offset, off_t end)
+{
+    Segment segment;
+
+    segment.mapping = mapping;
+    segment.offset = offset;
+    segment.end = end;
+    addSegment(segment);
+}
+
+void Response::addFile(const FileHandle &file, off_t offset, off_t end)
+{
+    Segment segment;
+
+    segment.file = file;
+    segment.offset = offset;
+    segment.end = end;
+    addSegment(segment);
+}
+
+/**
+ * @brief Appends part of a file as the body, without copying it: medium sized files are sent
+ * from a mapping shared with other downloads of the same file, and small and big ones with
+ * sendfile()
+ */
+void Response::addFileBody(const Representation &rep, off_t offset, off_t end)
+{
+    MappingHandle mapping;
+
+    if (rep.file->size > RESPONSE_CACHE_MAX_FILE && rep.file->size <= MMAP_MAX_FILE)
+        mapping = MappingCache::map(rep.path, *rep.file);
+    if (mapping.isNull())
+        addFile(rep.file, offset, end);
+    else
+        addMapping(mapping, offset, end);
+}
+
+/**
+ * @brief Streams the rest of the body with chunked encoding. Must be added last
+ */
+void Response::addStream(const StreamHandle &stream)
+{
+    _stream = stream;
+}
+
+/**
+ * @brief Writes the hex size line of a chunk into the CHUNK_PREFIX bytes of room in front of it
+ *
+ * @return size_t Where the size line starts
+ */
+static size_t writeChunkSize(std::string &chunk, size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t start = CHUNK_PREFIX;
+
+    // CRLF, then the hex digits backwards
+    chunk[--start] = '\n';
+    chunk[--start] = '\r';
+    for (; size != 0; size >>= 4)
+        chunk[--start] = hex[size & 15];
+    return start;
+}
+
+/**
+ * @brief Queues bytes stored after CHUNK_PREFIX bytes of room as one chunk. The chunk size line
+ * is written into the room, so the bytes are never copied
+ *
+ * @param last Whether the last chunk follows
+ */
+void Response::addChunk(const BufferHandle &chunk, bool last)
+{
+    Segment segment;
+
+    segment.offset = CHUNK_PREFIX;
+    if (chunk->size() != CHUNK_PREFIX)
     {
-        Log(ERR) << "Sending response failed: " << strerror(errno) << std::endl;
-        return SEND_FAIL;
+        segment.offset = writeChunkSize(*chunk, chunk->size() - CHUNK_PREFIX);
+        chunk->append(CRLF);
     }
-    else
+    if (last)
+        chunk->append(LAST_CHUNK);
+    segment.buffer = chunk;
+    segment.end = chunk->size();
+    addSegment(segment);
+}
+
+/**
+ * @brief Reads the next piece of a streamed body and queues it as a chunk. The last chunk is
+ * queued with the end of the stream
+ *
+ * @return int The STREAM_ result of the read
+ */
+int Response::pullStream()
+{
+    BufferHandle chunk(new std::string(CHUNK_PREFIX, ' '));
+
+    const int status = _stream->read(*chunk);
+    if (status == STREAM_ERROR || status == STREAM_AGAIN)
+        return status;
+    addChunk(chunk, status == STREAM_END);
+    if (status == STREAM_END)
+        _stream.reset();
+    return status;
+}
+
+/**
+ * @brief Marks bytes written by writev() as sent, moving past every segment they completed
+ */
+void Response::advance(size_t bytesSent)
+{
+    while (bytesSent > 0 && _current < _segments.size())
     {
-        _totalBytesSent += bytesSent;
-        if (_totalBytesSent < _length)   // partial send
+        Segment &segment = _segments[_current];
+        size_t left = segment.end - segment.offset;
+        if (bytesSent < left)
         {
-            Log(WARN) << "Response only sent partially: " << bytesSent
-                      << ". Total: " << _totalBytesSent << std::endl;
-            return SEND_PARTIAL;
+            segment.offset += bytesSent;
+            return;
         }
+        bytesSent -= left;
+        segment.offset = segment.end;
+        _current++;
     }
-    Log(SUCCESS) << "Response sent to connection " << fd << ". Size = " << _totalBytesSent
-                 << std::endl;
-    return SEND_SUCCESS;
 }
 
-template <typename streamType> static size_t getStreamLen(streamType &s)
+/**
+ * @brief Sends the in-memory segments starting at the current one with a single writev()
+ *
+ * @return ssize_t Bytes sent, or -1 on failure
+ */
+ssize_t Response::writeSegments(int fd)
 {
-    ssize_t len;
+    struct iovec iov[IOV_BATCH];
+    int count = 0;
+    size_t total = 0;
+    bool mapped = false;
 
-    s.seekg(0, std::ios::end);
-    len = s.tellg();
-    s.seekg(0, std::ios::beg);
-    if (len == -1)   // tellg failed
-        return 0;
-    return len;
+    for (size_t i = _current; i < _segments.size() && count < IOV_BATCH; i++)
+    {
+        const Segment &segment = _segments[i];
+        if (!segment.inMemory() || total >= SENDFILE_MAX)
+            break;
+        const char *data = segment.head ? _head.data() : segment.data();
+        iov[count].iov_base = const_cast<char *>(data + segment.offset);
+        iov[count].iov_len = segment.end - segment.offset;
+        total += iov[count].iov_len;
+        mapped = mapped || !segment.mapping.isNull();
+        count++;
+    }
+    const ssize_t bytesSent =
+        mapped ? MappingCache::guardedWritev(fd, iov, count) : writev(fd, iov, count);
+    if (bytesSent > 0)
+        advance(bytesSent);
+    else if (mapped && bytesSent == -1 && errno == EFAULT)
+    {
+        // the file was truncated while being sent, later downloads must not share the mapping
+        for (size_t i = _current; i < _current + count; i++)
+            if (!_segments[i].mapping.isNull())
+                _segments[i].mapping->faulted = true;
+    }
+    return bytesSent;
 }
 
-static bool isEmpty(std::ifstream &file)
+/**
+ * @brief Copies the next part of a file segment to a socket without passing it through
+ * userspace when the platform supports it
+ *
+ * @return ssize_t Bytes sent, or -1 on failure
+ */
+ssize_t Response::sendFileSegment(int fd)
 {
-    return file.peek() == std::ifstream::traits_type::eof();
+    Segment &segment = _segments[_current];
+    size_t count = segment.end - segment.offset;
+    ssize_t bytesSent;
+
+    if (count > SENDFILE_MAX)
+        count = SENDFILE_MAX;
+#ifdef __linux__
+    bytesSent = sendfile(fd, segment.file->fd, &segment.offset, count);
+#else
+    char chunk[WRITE_MAX];
+    ssize_t bytesRead = pread(segment.file->fd, chunk, WRITE_SIZE(count), segment.offset);
+    if (bytesRead <= 0)
+        return -1;
+    bytesSent = send(fd, chunk, bytesRead, 0);
+    if (bytesSent > 0)
+        segment.offset += bytesSent;
+#endif
+    if (segment.offset >= segment.end)
+        _current++;
+    return bytesSent;
 }
 
-void Response::createRedirectResponse(std::string &redirUrl, int statusCode, bool keepAlive)
+/**
+ * @brief Moves script output from its stdout pipe to the socket without copying it through
+ * userspace. Pipe segments are only queued on Linux
+ *
+ * @return ssize_t Bytes sent, or -1 on failure
+ */
+ssize_t Response::spliceSegment(int fd)
 {
-    std::stringstream responseBuffer;
+    Segment &segment = _segments[_current];
+    ssize_t bytesSent = -1;
+
+#ifdef __linux__
+    bytesSent = splice(segment.pipe, NULL, fd, NULL, segment.end - segment.offset,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+    (void) fd;
+#endif
+    if (bytesSent > 0)
+        segment.offset += bytesSent;
+    if (segment.offset >= segment.end)
+        _current++;
+    return bytesSent;
+}
 
+/**
+ * @brief Whether sendResponse() has something to send, the socket only needs to be polled for
+ * writing if it does
+ */
+bool Response::hasOutput() const
+{
+    return _current < _segments.size() || !_stream.isNull() || (!_cgi.isNull() && _cgi->failed);
+}
+
+/**
+ * @brief Sends as much of the remaining segments as the socket accepts, up to SENDFILE_MAX
+ * bytes per call. Consecutive in-memory segments go out together with writev()
+ */
+int Response::sendResponse(int fd)
+{
+    ssize_t bytesSent;
+    size_t sentNow = 0;
+
+    if (_length == 0)
+        return _cgi.isNull() ? IDLE_CONNECTION : SEND_PARTIAL;
+    if (_totalBytesSent == 0)
+        Log(INFO) << "Sending a response... " << std::endl;
+    while (_current < _segments.size() || !_stream.isNull() || !_cgi.isNull())
+    {
+        if (sentNow >= SENDFILE_MAX)
+            return SEND_PARTIAL;
+        if (_current == _segments.size())
+        {
+            // everything produced so far is sent, so the stream may produce more
+            const int status = _stream.isNull() ? pullCGIOutput() : pullStream();
+            if (status == STREAM_AGAIN)
+            {
+                if (!_cgi.isNull())
+                    _cgi->touch();   // waiting for the script starts now
+                return SEND_PARTIAL;
+            }
+            if (status == STREAM_ERROR)
+            {
+                Log(ERR) << "Streamed response body failed" << std::endl;
+                return SEND_FAIL;
+            }
+            continue;
+        }
+        if (_segments[_current].inMemory())
+            bytesSent = writeSegments(fd);
+        else if (_segments[_current].pipe != -1)
+            bytesSent = spliceSegment(fd);
+        else
+            bytesSent = sendFileSegment(fd);
+        if (bytesSent <= 0)
+        {
+            if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return SEND_PARTIAL;
+            Log(ERR) << "Sending response failed: " << strerror(errno) << std::endl;
+            return SEND_FAIL;
+        }
+        _totalBytesSent += bytesSent;
+        sentNow += bytesSent;
+    }
+    Log(SUCCESS) << "Response sent to connection " << fd << ". Size = " << _totalBytesSent
+                 << std::endl;
+    return SEND_SUCCESS;
+}
+
+void Response::createRedirectResponse(std::string &redirUrl, int statusCode, bool keepAlive)
+{
     Log(DBUG) << "Redirected to " << redirUrl << std::endl;
-    responseBuffer << STATUS_LINE << getStatus(statusCode);
-    Log(DBUG) << responseBuffer.str() << std::endl;
-    responseBuffer << CRLF;
-    responseBuffer << LOCATION << redirUrl << CRLF;
+    Log(DBUG) << STATUS_LINE << statusCode << std::endl;
+    _head.statusLine(statusCode);
+    _head.header(LOCATION, redirUrl);
     if (keepAlive)
-        responseBuffer << KEEP_ALIVE << CRLF;
-    responseBuffer << CONTENT_LEN << "0" << CRLF;
-    responseBuffer << CRLF;
-    _length = getStreamLen(responseBuffer);
-    if (_buffer != NULL)
-        delete[] _buffer;
-    _buffer = new char[_length];
-    responseBuffer.read(_buffer, _length);
-}
-
-void Response::setResponseHeaders(std::stringstream &ss, Headers h)
-{
-    ss << STATUS_LINE << getStatus(h.statusCode);
-    Log(DBUG) << ss.str() << std::endl;
-    ss << CRLF;
-    if (!h.contentType.empty())
-        ss << CONTENT_TYPE << h.contentType << CRLF;
-    ss << CONTENT_LEN << h.contentLen << CRLF;
+        _head.line(KEEP_ALIVE CRLF, sizeof(KEEP_ALIVE CRLF) - 1);
+    _head.line(CONTENT_LEN "0" CRLF, sizeof(CONTENT_LEN "0" CRLF) - 1);
+    _head.end();
+    addHead();
+}
+
+/**
+ * @brief Writes the status line and the common headers, leaving the head open for more headers
+ */
+void Response::writeHeaders(const Headers &h)
+{
+    Log(DBUG) << STATUS_LINE << h.statusCode << std::endl;
+    _head.statusLine(h.statusCode, h.cachePolicy != NULL ? h.cachePolicy->expires : NO_EXPIRES);
+    if (*h.contentType != '\0')
+        _head.header(CONTENT_TYPE, h.contentType);
+    if (h.chunked)
+        _head.line(CHUNKED CRLF, sizeof(CHUNKED CRLF) - 1);
+    else if (h.statusCode != 304)
+        _head.header(CONTENT_LEN, h.contentLen);
+    if (h.file != NULL)
+    {
+        char value[ETAG_MAX + 2];
+        size_t length = 0;
+        if (h.weakETag)
+        {
+            memcpy(value, "W/", 2);
+            length = 2;
+        }
+        length += formatETag(*h.file, value + length);
+        _head.header(ETAG, value, length);
+        _head.header(LAST_MODIFIED, value, formatHTTPDate(h.file->mtime, value));
+        // ranges are only served from the file itself, never from a compressed body
+        if (!h.weakETag)
+            _head.line(ACCEPT_RANGES CRLF, sizeof(ACCEPT_RANGES CRLF) - 1);
+    }
+    if (h.cachePolicy != NULL && !h.cachePolicy->header.empty())
+        _head.line(h.cachePolicy->header.data(), h.cachePolicy->header.length());
+    if (h.contentEncoding != NULL)
+        _head.header(CONTENT_ENC, h.contentEncoding);
+    if (h.vary)
+        _head.line(VARY_ENCODING CRLF, sizeof(VARY_ENCODING CRLF) - 1);
+    if (h.retryAfter != 0)
+        _head.header(RETRY_AFTER, h.retryAfter);
     if (h.keepAlive)
-        ss << KEEP_ALIVE << CRLF;
-    ss << CRLF;
+        _head.line(KEEP_ALIVE CRLF, sizeof(KEEP_ALIVE CRLF) - 1);
 }
 
-static Headers createHeaders(int statusCode, std::string contentType, size_t contentLen,
+void Response::setResponseHeaders(const Headers &h)
+{
+    writeHeaders(h);
+    _head.end();
+    addHead();
+}
+
+static Headers createHeaders(int statusCode, const char *contentType, size_t contentLen,
                              bool keepAlive)
 {
     Headers h;
@@ -177,254 +503,932 @@ static Headers createHeaders(int statusCode, std::string contentType, size_t con
     h.contentType = contentType;
     h.contentLen = contentLen;
     h.keepAlive = keepAlive;
+    h.file = NULL;
+    h.contentEncoding = NULL;
+    h.vary = false;
+    h.weakETag = false;
+    h.cachePolicy = NULL;
+    h.chunked = false;
+    h.retryAfter = 0;
 
     return h;
 }
 
-void Response::setResponse(std::stringstream &ss)
+static Headers fileHeaders(int statusCode, const Representation &rep, bool keepAlive)
 {
-    _length = getStreamLen(ss);
-    if (_buffer != NULL)
-        delete[] _buffer;
-    _buffer = new char[_length];
-    ss.read(_buffer, _length);
+    Headers h = createHeaders(statusCode, rep.mimeType.c_str(), rep.file->size, keepAlive);
+
+    h.file = rep.file.get();
+    h.contentEncoding = rep.encoding;
+    h.vary = rep.vary;
+    h.weakETag = rep.weakETag;
+    h.cachePolicy = rep.cachePolicy;
+    if (statusCode == 304)
+        h.contentType = NO_CONTENT;
+    return h;
 }
 
-void Response::createGETResponse(Request &request)
+/**
+ * @brief Text files compress well and are worth looking for precompressed copies of
+ */
+static bool isCompressible(const std::string &mimeType)
 {
-    std::ifstream file;
-    std::stringstream responseBuffer;
-    std::string mimeType;
-    size_t fileSize;
+    return mimeType.compare(0, 5, "text/") == 0 || mimeType == "application/javascript" ||
+           mimeType == "application/json" || mimeType == "application/xml" ||
+           mimeType == "image/svg+xml";
+}
 
-    file.open(request.resource().path.c_str(), std::ios::binary);
-    if (!file.good())
-        return createHTMLResponse(404, errorPage(404, request.resource()), false);
-    mimeType = getContentType(request.resource().path);
-    if (isEmpty(file))
-        fileSize = 0;
-    else
-        fileSize = getStreamLen(file);
-    setResponseHeaders(responseBuffer, createHeaders(200, mimeType, fileSize, request.keepAlive()));
-    if (fileSize > 0)
-        responseBuffer << file.rdbuf();
-    file.close();
+/**
+ * @brief Finds the caching headers of a file: the policy for its extension if there is one,
+ * otherwise the route's policy for all files
+ *
+ * @return const CachePolicy* The policy, NULL if the route sends no caching headers
+ */
+static const CachePolicy *findCachePolicy(const Route &route, const std::string &path)
+{
+    const std::map<std::string, CachePolicy> &policies = route.cachePolicies;
+
+    if (policies.empty())
+        return NULL;
+    const size_t dot = path.rfind('.');
+    if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+    {
+        std::string extension = path.substr(dot);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        std::map<std::string, CachePolicy>::const_iterator it = policies.find(extension);
+        if (it != policies.end())
+            return &it->second;
+    }
+    std::map<std::string, CachePolicy>::const_iterator it = policies.find("");
+    return it != policies.end() ? &it->second : NULL;
+}
+
+static long expiresOf(const CachePolicy *policy)
+{
+    return policy != NULL ? policy->expires : NO_EXPIRES;
+}
+
+/**
+ * @brief Checks if a route compresses responses of a content type on the fly. Parameters like
+ * charset are ignored
+ */
+static bool compressesType(const Route &route, const std::string &contentType)
+{
+    if (route.compressTypes.empty())
+        return false;
+    std::string type = contentType.substr(0, contentType.find(';'));
+    type.erase(type.find_last_not_of(' ') + 1);
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    return route.compressTypes.count(type) != 0;
+}
+
+static bool acceptsGzip(Request &request)
+{
+    std::map<std::string, std::string>::const_iterator accepted =
+        request.headers().find("accept-encoding");
+    return accepted != request.headers().end() && acceptsEncoding(accepted->second, "gzip");
+}
 
-    setResponse(responseBuffer);
+/**
+ * @brief Checks if a file is gzipped on the fly: no precompressed copy was found, the route
+ * compresses its type and the file is neither too small to gain anything nor too big to hold
+ * in memory
+ */
+static bool shouldCompress(Request &request, const Representation &rep)
+{
+    const Route &route = request.resource().config.second;
+
+    return rep.encoding == NULL && rep.file->size >= static_cast<off_t>(route.compressMinLength) &&
+           rep.file->size <= COMPRESS_MAX_FILE && compressesType(route, rep.mimeType) &&
+           acceptsGzip(request);
+}
+
+/**
+ * @brief Opens the file a static file request is answered with. For text files, the smallest
+ * precompressed sibling (file.br, file.zst or file.gz) that the client accepts is used instead,
+ * as long as it is not older than the file itself. Sibling lookups go through the open file
+ * cache, which also remembers the ones that do not exist
+ *
+ * @return false if the requested file does not exist
+ */
+static bool openRepresentation(Request &request, Representation &rep)
+{
+    static const char *codings[][2] = {{"br", ".br"}, {"zstd", ".zst"}, {"gzip", ".gz"}};
+    const Resource &resource = request.resource();
+
+    rep.path = resource.path;
+    rep.encoding = NULL;
+    rep.weakETag = false;
+    rep.cachePolicy = findCachePolicy(resource.config.second, resource.path);
+    rep.file = FileCache::open(resource.path, resource.config.second);
+    if (rep.file.isNull())
+        return false;
+    rep.mimeType = rep.file->mimeType;
+    rep.vary = isCompressible(rep.mimeType) || compressesType(resource.config.second, rep.mimeType);
+    std::map<std::string, std::string>::const_iterator accepted =
+        request.headers().find("accept-encoding");
+    if (!rep.vary || accepted == request.headers().end())
+        return true;
+
+    const FileHandle original = rep.file;
+    for (size_t i = 0; i < sizeOfArray(codings); i++)
+    {
+        if (!acceptsEncoding(accepted->second, codings[i][0]))
+            continue;
+        const std::string &path = resource.path + codings[i][1];
+        FileHandle compressed = FileCache::open(path, resource.config.second, true);
+        if (compressed.isNull() || compressed->mtime < original->mtime ||
+            compressed->size >= rep.file->size)
+            continue;
+        rep.file = compressed;
+        rep.path = path;
+        rep.encoding = codings[i][0];
+    }
+    return true;
+}
+
+/**
+ * @brief Checks if a Range header should be honoured. With If-Range, the range only applies if
+ * the client's validator is still current, otherwise the whole file is sent
+ */
+static bool rangeApplies(Request &request, const OpenFile &file)
+{
+    std::map<std::string, std::string> &headers = request.headers();
+    std::map<std::string, std::string>::const_iterator it = headers.find("if-range");
+    char validator[ETAG_MAX];
+
+    if (headers.count("range") == 0)
+        return false;
+    if (it == headers.end())
+        return true;
+    // If-Range requires a strong comparison, so weak tags never match
+    if (it->second[0] == '"')
+        return it->second.compare(0, std::string::npos, validator,
+                                  formatETag(file, validator)) == 0;
+    return parseHTTPDate(it->second) == file.mtime;
+}
+
+static bool isConditional(Request &request)
+{
+    return request.headers().count("if-none-match") != 0 ||
+           request.headers().count("if-modified-since") != 0;
+}
+
+/**
+ * @brief Answers with 304 Not Modified if the client's copy of the file is still current.
+ * If-None-Match takes precedence over If-Modified-Since when both are sent
+ *
+ * @return true if the 304 response was created
+ */
+bool Response::createNotModifiedResponse(Request &request, const Representation &rep)
+{
+    const OpenFile &file = *rep.file;
+    std::map<std::string, std::string> &headers = request.headers();
+    std::map<std::string, std::string>::const_iterator it;
+    bool notModified = false;
+
+    it = headers.find("if-none-match");
+    if (it != headers.end())
+    {
+        char etag[ETAG_MAX];
+        notModified = etagListMatches(it->second, etag, formatETag(file, etag));
+    }
+    else if ((it = headers.find("if-modified-since")) != headers.end())
+    {
+        time_t since = parseHTTPDate(it->second);
+        notModified = since != -1 && file.mtime <= since;
+    }
+    if (notModified)
+        setResponseHeaders(fileHeaders(304, rep, request.keepAlive()));
+    return notModified;
+}
+
+/**
+ * @brief Answers a Range request with 206 Partial Content, or 416 if no range overlaps the file
+ *
+ * @return true if the response was created, false if the Range header is ignored and the whole
+ * file should be sent
+ */
+bool Response::createRangeResponse(Request &request, const Representation &rep)
+{
+    const FileHandle &file = rep.file;
+    std::vector<ByteRange> ranges;
+    char value[CONTENT_RANGE_MAX];
+    Headers h;
+
+    switch (parseRanges(request.headers()["range"], file->size, ranges))
+    {
+    case RANGE_IGNORED:
+        return false;
+    case RANGE_UNSATISFIABLE:
+    {
+        const BufferHandle &page = ErrorPages::find(416, request.resource()).body;
+        writeHeaders(createHeaders(416, HTML, page->size(), request.keepAlive()));
+        _head.header(CONTENT_RANGE, value, formatContentRange(NULL, file->size, value));
+        _head.end();
+        addHead();
+        addBuffer(page);
+        return true;
+    }
+    }
+    if (ranges.size() > 1)
+    {
+        createMultipartResponse(request, rep, ranges);
+        return true;
+    }
+    h = fileHeaders(206, rep, request.keepAlive());
+    h.contentLen = ranges[0].end - ranges[0].start;
+    writeHeaders(h);
+    _head.header(CONTENT_RANGE, value, formatContentRange(&ranges[0], file->size, value));
+    _head.end();
+    addHead();
+    addFileBody(rep, ranges[0].start, ranges[0].end);
+    return true;
+}
+
+/**
+ * @brief Sends several ranges of a file as a multipart/byteranges body. Every part is a small
+ * in-memory header followed by the range itself, sent from the file like a whole-file body
+ */
+void Response::createMultipartResponse(Request &request, const Representation &rep,
+                                       const std::vector<ByteRange> &ranges)
+{
+    const FileHandle &file = rep.file;
+    std::vector<BufferHandle> partHeads;
+    char value[CONTENT_RANGE_MAX];
+    char boundary[ETAG_MAX];
+    size_t contentLen = 0;
+
+    // the entity tag is unique to this version of the file and never occurs in the headers
+    size_t boundaryLen = formatETag(*file, boundary);
+    std::string separator(boundary + 1, boundaryLen - 2);
+    separator = "webserv-" + separator;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        BufferHandle part(new std::string(CRLF "--" + separator + CRLF));
+        if (!rep.mimeType.empty())
+            *part += CONTENT_TYPE + rep.mimeType + CRLF;
+        *part += CONTENT_RANGE;
+        part->append(value, formatContentRange(&ranges[i], file->size, value));
+        *part += CRLF CRLF;
+        partHeads.push_back(part);
+        contentLen += part->size() + (ranges[i].end - ranges[i].start);
+    }
+    BufferHandle closing(new std::string(CRLF "--" + separator + "--" CRLF));
+    contentLen += closing->size();
+
+    const std::string contentType = BYTERANGES + separator;
+    Headers h = fileHeaders(206, rep, request.keepAlive());
+    h.contentType = contentType.c_str();
+    h.contentLen = contentLen;
+    setResponseHeaders(h);
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        addBuffer(partHeads[i]);
+        addFileBody(rep, ranges[i].start, ranges[i].end);
+    }
+    addBuffer(closing);
+}
+
+/**
+ * @brief Serializes a small file response into memory and stores it in the response cache
+ *
+ * @return true if the response was created, false if the file could not be read
+ */
+bool Response::createCachedGETResponse(Request &request, const Representation &rep,
+                                       const std::string &cacheKey)
+{
+    const FileHandle &file = rep.file;
+    ssize_t bytesRead;
+
+    setResponseHeaders(fileHeaders(200, rep, request.keepAlive()));
+    // the status and Date lines are written fresh for every hit, the rest of the head is cached
+    BufferHandle response(new std::string(_head.data() + _head.preambleEnd(),
+                                          _head.length() - _head.preambleEnd()));
+    const size_t headLen = response->size();
+    response->resize(headLen + file->size);
+    for (off_t offset = 0; offset < file->size; offset += bytesRead)
+    {
+        bytesRead = pread(file->fd, &(*response)[headLen + offset], file->size - offset, offset);
+        if (bytesRead <= 0)
+            return false;
+    }
+    ResponseCache::getCache().insert(cacheKey, rep.path, *file, response);
+    _head.preamble(200, expiresOf(rep.cachePolicy));
+    addHead();
+    addBuffer(response);
+    return true;
+}
+
+/**
+ * @brief Sends a file gzipped on the fly. Compressed files are cached until they change on disk.
+ * Files too big to compress in the event loop are handed to the compression worker and sent
+ * uncompressed until it is done
+ *
+ * @return true if the compressed response was created
+ */
+bool Response::createCompressedGETResponse(Request &request, const Representation &rep)
+{
+    CompressionCache &cache = CompressionCache::getCache();
+    const int level = request.resource().config.second.compressLevel;
+    BufferHandle compressed = cache.find(rep.path, *rep.file, level);
+
+    if (compressed.isNull())
+    {
+        if (rep.file->size > COMPRESS_SYNC_MAX)
+        {
+            cache.schedule(rep.path, *rep.file, level);
+            return false;
+        }
+        compressed = BufferHandle(new std::string);
+        if (!gzipCompressFile(rep.file->fd, rep.file->size, level, *compressed))
+            return false;
+        // incompressible files are cached too, so they are not compressed again on every request
+        cache.insert(rep.path, *rep.file, level, compressed);
+    }
+    if (compressed->size() >= static_cast<size_t>(rep.file->size))
+        return false;
+    Headers h = fileHeaders(200, rep, request.keepAlive());
+    h.contentLen = compressed->size();
+    h.contentEncoding = "gzip";
+    setResponseHeaders(h);
+    addBuffer(compressed);
+    return true;
+}
+
+/**
+ * @brief Answers from the response cache
+ *
+ * @return true on a cache hit
+ */
+bool Response::createCachedResponse(const std::string &cacheKey, const CachePolicy *policy)
+{
+    BufferHandle cached = ResponseCache::getCache().find(cacheKey);
+
+    if (cached.isNull())
+        return false;
+    _head.preamble(200, expiresOf(policy));
+    addHead();
+    addBuffer(cached);
+    return true;
+}
+
+void Response::createGETResponse(Request &request)
+{
+    const Resource &resource = request.resource();
+    const ServerBlock &block = resource.config.first;
+    Representation rep;
+
+    // conditional and range requests need the file's validators, so they skip the response
+    // cache. Without content negotiation, the file to send is known before opening it
+    const bool conditional = isConditional(request);
+    // ranges are only defined for GET, a HEAD describes the whole file
+    const bool ranged = request.method() == GET && request.headers().count("range") != 0;
+    const bool cacheable = !conditional && !ranged;
+    const bool negotiated = request.headers().count("accept-encoding") != 0;
+    if (cacheable && !negotiated &&
+        createCachedResponse(ResponseCache::key(block.port, block.hostnames[0], resource.path,
+                                                request.keepAlive()),
+                             findCachePolicy(resource.config.second, resource.path)))
+        return;
+    if (!openRepresentation(request, rep))
+        return createErrorResponse(404, resource, false);
+    // files compressed on the fly are cached by the compression cache instead
+    rep.weakETag = !ranged && shouldCompress(request, rep);
+    const std::string &cacheKey =
+        ResponseCache::key(block.port, block.hostnames[0], rep.path, request.keepAlive());
+    if (cacheable && negotiated && !rep.weakETag && createCachedResponse(cacheKey, rep.cachePolicy))
+        return;
+    if (conditional && createNotModifiedResponse(request, rep))
+        return;
+    if (ranged && rangeApplies(request, *rep.file) && createRangeResponse(request, rep))
+        return;
+    if (rep.weakETag && createCompressedGETResponse(request, rep))
+        return;
+    if (rep.file->size <= RESPONSE_CACHE_MAX_FILE && !rep.weakETag &&
+        createCachedGETResponse(request, rep, cacheKey))
+        return;
+    setResponseHeaders(fileHeaders(200, rep, request.keepAlive()));
+    addFileBody(rep, 0, rep.file->size);
 }
 
 void Response::createFileResponse(Request &request, int statusCode)
 {
-    std::stringstream responseBuffer;
     std::ofstream file;
     std::string filename = request.resource().path;
+    std::string tmpFilename = filename + ".webserv-tmp";
 
     // if (isDir(request.resource().path))
     //     filename += "/dirfile";
-    file.open(filename.c_str());
+    // the new contents are written next to the file and renamed over it, so responses still
+    // sending the old file from an fd or a mapping keep reading the old inode instead of a
+    // truncated file (which would raise SIGBUS when touching the mapping)
+    file.open(tmpFilename.c_str());
     if (!file.good())
     {
         Log(ERR) << "Cannot open file to write: " << filename << std::endl;
-        return createHTMLResponse(500, errorPage(500, request.resource()), false);
+        return createErrorResponse(500, request.resource(), false);
     }
     Log(DBUG) << "file being posted is " << request.resource().path << std::endl;
     file.write(request.buffer() + request.bodyStart(), request.length() - request.bodyStart());
     file.close();
-    responseBuffer << STATUS_LINE << getStatus(statusCode);
-    Log(DBUG) << responseBuffer.str() << std::endl;
-    responseBuffer << CRLF;
+    if (file.fail() || std::rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        Log(ERR) << "Cannot write file: " << filename << std::endl;
+        std::remove(tmpFilename.c_str());
+        return createErrorResponse(500, request.resource(), false);
+    }
+    FileCache::invalidate(filename, request.resource().config.second);
+    ResponseCache::getCache().invalidate(filename);
+    CompressionCache::getCache().invalidate(filename);
+    Log(DBUG) << STATUS_LINE << statusCode << std::endl;
+    _head.statusLine(statusCode);
     if (request.keepAlive())
-        responseBuffer << KEEP_ALIVE << CRLF;
-    responseBuffer << LOCATION << request.resource().originalRequest << CRLF;
-    responseBuffer << CRLF;
-    setResponse(responseBuffer);
+        _head.line(KEEP_ALIVE CRLF, sizeof(KEEP_ALIVE CRLF) - 1);
+    _head.header(LOCATION, request.resource().originalRequest);
+    _head.end();
+    addHead();
 }
 
 void Response::createDELETEResponse(Request &request)
 {
-    std::stringstream responseBuffer;
     int status;
 
     status = std::remove(request.resource().path.c_str());
+    FileCache::invalidate(request.resource().path, request.resource().config.second);
+    ResponseCache::getCache().invalidate(request.resource().path);
+    CompressionCache::getCache().invalidate(request.resource().path);
     if (status != 0)
     {
         Log(ERR) << "Cannot delete file " << request.resource().path << std::endl;
-        return createHTMLResponse(500, errorPage(500, request.resource()), false);
+        return createErrorResponse(500, request.resource(), false);
     }
-    responseBuffer << STATUS_LINE << getStatus(204);
-    Log(DBUG) << responseBuffer.str() << std::endl;
-    responseBuffer << CRLF;
+    Log(DBUG) << STATUS_LINE << 204 << std::endl;
+    _head.statusLine(204);
     if (request.keepAlive())
-        responseBuffer << KEEP_ALIVE << CRLF;
-    responseBuffer << CRLF;
-    setResponse(responseBuffer);
+        _head.line(KEEP_ALIVE CRLF, sizeof(KEEP_ALIVE CRLF) - 1);
+    _head.end();
+    addHead();
+}
+
+/**
+ * @brief Decides if the pages generated for a request (error pages, directory listings) are
+ * gzipped. Called before the request is processed, as the page is made without the request
+ */
+void Response::negotiateCompression(Request &request)
+{
+    const Route &route = request.resource().config.second;
+
+    _htmlCompressLevel = 0;
+    if (!compressesType(route, HTML))
+        return;
+    _htmlCompressLevel = acceptsGzip(request) ? route.compressLevel : -1;
+    _htmlCompressMinLength = route.compressMinLength;
 }
 
 void Response::createHTMLResponse(int statusCode, std::string page, bool keepAlive)
 {
-    std::stringstream responseBuffer;
+    createHTMLResponse(statusCode, BufferHandle(new std::string(page)), keepAlive);
+}
+
+void Response::createHTMLResponse(int statusCode, const BufferHandle &page, bool keepAlive)
+{
+    Headers h = createHeaders(statusCode, HTML, page->size(), keepAlive);
 
-    setResponseHeaders(responseBuffer, createHeaders(statusCode, HTML, page.length(), keepAlive));
-    responseBuffer << page;
-    setResponse(responseBuffer);
+    // a negative level means the route compresses pages but this client does not accept gzip
+    h.vary = _htmlCompressLevel != 0;
+    if (_htmlCompressLevel > 0 && page->size() >= _htmlCompressMinLength &&
+        page->size() <= COMPRESS_SYNC_MAX)
+    {
+        BufferHandle compressed(new std::string);
+        if (gzipCompress(page->data(), page->size(), _htmlCompressLevel, *compressed) &&
+            compressed->size() < page->size())
+        {
+            h.contentLen = compressed->size();
+            h.contentEncoding = "gzip";
+            setResponseHeaders(h);
+            return addBuffer(compressed);
+        }
+    }
+    setResponseHeaders(h);
+    addBuffer(page);
 }
 
-void Response::createHEADFileResponse(Request &request)
+/**
+ * @brief Sends the listing of a directory. Listings are cached until the directory changes.
+ * Small directories and sorted or paged listings are rendered whole, while the listing of a
+ * large directory is streamed as it is read
+ */
+void Response::createListingResponse(Request &request)
 {
-    std::ifstream file;
-    std::stringstream responseBuffer;
-    std::string mimeType;
-    size_t fileSize;
+    const Resource &dir = request.resource();
+    const ListingOptions options(request.query());
+    ListingCache::Version version;
 
-    file.open(request.resource().path.c_str(), std::ios::binary);
-    if (!file.good())
-        return createHTMLResponse(404, errorPage(404, request.resource()), false);
-    mimeType = getContentType(request.resource().path);
-    if (isEmpty(file))
-        fileSize = 0;
-    else
-        fileSize = getStreamLen(file);
-    setResponseHeaders(responseBuffer, createHeaders(200, mimeType, fileSize, request.keepAlive()));
-    file.close();
-    setResponse(responseBuffer);
+    if (!ListingCache::version(dir.path, version))
+        return createErrorResponse(404, dir, request.keepAlive());
+    const std::string &key = ListingCache::key(dir, options);
+    BufferHandle page = ListingCache::find(key, version);
+    if (!page.isNull())
+        return createHTMLResponse(200, page, request.keepAlive());
+
+    DirectoryStream *stream = new DirectoryStream(dir, key, version);
+    StreamHandle handle(stream);
+    if (!stream->open(dir.path))
+    {
+        Log(ERR) << "Cannot open directory " << dir.path << ": " << strerror(errno) << std::endl;
+        return createErrorResponse(500, dir, request.keepAlive());
+    }
+    if (stream->readAhead(options.wholeDirectory() ? STREAM_MIN : std::string::npos))
+    {
+        page = BufferHandle(new std::string(renderListing(dir, options, stream->names())));
+        ListingCache::insert(key, version, page);
+        return createHTMLResponse(200, page, request.keepAlive());
+    }
+    if (!options.wholeDirectory())
+        return createErrorResponse(500, dir, request.keepAlive());
+
+    Headers h = createHeaders(200, HTML, 0, request.keepAlive());
+    h.chunked = true;
+    h.vary = _htmlCompressLevel != 0;
+    setResponseHeaders(h);
+    addStream(handle);
+}
+
+/**
+ * @brief Sends the error page for a status code. The body is shared with the error page store,
+ * so only the head is written per response
+ *
+ * @param retryAfter Seconds the client is told to wait in a Retry-After header, 0 for none
+ */
+void Response::createErrorResponse(int statusCode, const Resource &resource, bool keepAlive,
+                                   unsigned int retryAfter)
+{
+    ErrorPage &page = ErrorPages::find(statusCode, resource);
+    Headers h = createHeaders(statusCode, HTML, page.body->size(), keepAlive);
+
+    h.retryAfter = retryAfter;
+    h.vary = _htmlCompressLevel != 0;
+    if (_htmlCompressLevel > 0 && page.body->size() >= _htmlCompressMinLength)
+    {
+        const BufferHandle &compressed = ErrorPages::compressed(page, _htmlCompressLevel);
+        if (!compressed.isNull() && compressed->size() < page.body->size())
+        {
+            h.contentLen = compressed->size();
+            h.contentEncoding = "gzip";
+            setResponseHeaders(h);
+            return addBuffer(compressed);
+        }
+    }
+    setResponseHeaders(h);
+    addBuffer(page.body);
 }
 
-void Response::createHEADResponse(int statusCode, std::string contentType, bool keepAlive)
+void Response::createHEADFileResponse(Request &request)
 {
-    std::stringstream responseBuffer;
+    // the same representation as for a GET, so the headers match what a GET would get
+    createGETResponse(request);
+    trimBody();
+}
 
-    setResponseHeaders(responseBuffer, createHeaders(statusCode, contentType, 0, keepAlive));
-    setResponse(responseBuffer);
+void Response::createHEADResponse(int statusCode, const char *contentType, bool keepAlive)
+{
+    setResponseHeaders(createHeaders(statusCode, contentType, 0, keepAlive));
 }
 
 void Response::trimBody()
 {
     const char doubleCRLF[] = "\r\n\r\n";
-    const char *bodyStart = std::search(_buffer, _buffer + _length, doubleCRLF,
-                                        doubleCRLF + sizeOfArray(doubleCRLF) - 1);
-    if (bodyStart != _buffer + _length)
-        _length = bodyStart - _buffer + 4;
+
+    // generated responses keep their whole head in _head, cached ones keep all but the status
+    // and Date lines in the buffer after it
+    for (size_t i = 0; i < _segments.size() && (_segments[i].head || !_segments[i].buffer.isNull());
+         i++)
+    {
+        Segment &segment = _segments[i];
+        const char *data = segment.head ? _head.data() : segment.data();
+        const char *bodyStart = std::search(data + segment.offset, data + segment.end, doubleCRLF,
+                                            doubleCRLF + sizeOfArray(doubleCRLF) - 1);
+        if (bodyStart == data + segment.end)
+            continue;
+        segment.end = bodyStart - data + 4;
+        _segments.resize(i + 1);
+        _length = 0;
+        for (size_t j = 0; j < _segments.size(); j++)
+            _length += _segments[j].end - _segments[j].offset;
+        return;
+    }
 }
 
-void Response::runCGI(int p[2], int outFd, Request &req, std::vector<char *> env)
+/**
+ * @brief Starts the CGI script of the request, or sends it to the location's FastCGI application
+ * or CGI pool, unless the location's cgi_cache has its output. Locations with
+ * cgi_max_concurrency may queue the request, or turn it away with a 503 when the queue is full.
+ * The response stays empty until the script has written its headers, updateCGI() takes it from
+ * there
+ */
+void Response::createCGIResponse(Request &req, const CGIEnvironment &env)
 {
-    chdir(dirName(req.resource().path).c_str());
-    close(p[1]);
-    dup2(p[0], STDIN_FILENO);
-    close(p[0]);
-    dup2(outFd, STDOUT_FILENO);
-    close(outFd);
-    // std::string filename = "/Users/mfirdous/Desktop/Cursus/webserv/cgi_tester";
+    const Route &route = req.resource().config.second;
+    // only GET requests without a body are answered from the cgi_cache
+    const bool cached = route.cgiCacheTTL != 0 && req.method() == GET &&
+                        !req.usesContentLength() && !req.usesChunkedEncoding();
+    CGIHandle cgi = cached ? CGICache::getCache().open(req, env) : CGIBackend::start(req, env);
 
-    std::string filename = "./";
-    filename += baseName(req.resource().path);
-    std::vector<char *> args = createExecArgs(filename);
-
-    if (execve(filename.c_str(), &args[0], &env[0]) == -1)
+    if (cgi.isNull() && CGIQueue::full(req.resource()))
+        return createErrorResponse(503, req.resource(), req.keepAlive(), CGI_RETRY_AFTER);
+    if (cgi.isNull())
     {
-        std::for_each(env.begin(), env.end(), free);
-        std::for_each(args.begin(), args.end(), free);
-        Log(ERR) << "Execve failed" << std::endl;
-        throw SystemCallException(std::string("execve: ") + strerror(errno) + filename);
+        const int statusCode = FastCGIClient::upstreamOf(route).empty() ? 500 : 502;
+        return createErrorResponse(statusCode, req.resource(), req.keepAlive());
     }
+    clear();
+    cgi->clientAcceptsGzip = acceptsGzip(req);
+    _cgi = cgi;
+    // a cached output is ready without any event to wait for
+    if (cached)
+        updateCGI(time(NULL));
 }
 
-void Response::readCGIResponse(Request &req)
+bool Response::runningCGI() const
 {
-    Log(DBUG) << "Reading CGI response... " << std::endl;
-    std::ifstream file;
-    std::stringstream responseBuffer;
-    size_t fileSize;
+    return !_cgi.isNull();
+}
 
-    responseBuffer << STATUS_LINE << getStatus(200) << CRLF;
-    file.open(CGI_OUTFILE, std::ios::binary);
-    if (!file.good())
-        return createHTMLResponse(500, errorPage(500, req.resource()), req.keepAlive());
-    if (isEmpty(file))
-        fileSize = 0;
-    else
-        fileSize = getStreamLen(file);
-    if (fileSize > 0)
-        responseBuffer << file.rdbuf();
-    file.close();
-    std::remove(CGI_OUTFILE);
-    setResponse(responseBuffer);
-    Log(DBUG) << "Cgi output length = " << _length << std::endl;
+void Response::addCGIPollFds(std::vector<pollfd> &fds) const
+{
+    if (!_cgi.isNull())
+        _cgi->addPollFds(fds, !hasOutput());
 }
 
-int Response::sendCGIRequestBody(int pipeFd, Request &req)
+/**
+ * @brief Passes body bytes of a request whose script is already running to the script
+ *
+ * @return size_t How many of the bytes were part of the body
+ */
+size_t Response::feedCGI(const char *data, size_t len)
 {
-    size_t totalBytes = 0;
-    ssize_t bytesWritten;
-    time_t startTime;
-    time_t curTime;
-    size_t bodySize = req.length() - req.bodyStart();
-    const char *body = req.buffer() + req.bodyStart();
+    if (_cgi.isNull())
+        return 0;
+    return _cgi->feed(data, len);
+}
 
-    if (fcntl(pipeFd, F_SETFL, O_NONBLOCK) == -1)
-    {
-        close(pipeFd);
-        return 500;
-    }
-    time(&startTime);
-    while (totalBytes < bodySize)
+bool Response::cgiInputFull() const
+{
+    return !_cgi.isNull() && _cgi->inputFull();
+}
+
+/**
+ * @brief Replaces the response with an error page and stops the script, for failures before its
+ * headers were sent
+ */
+void Response::failCGI(int statusCode)
+{
+    CGIHandle cgi = _cgi;
+
+    _cgi.reset();
+    cgi->terminate();
+    createErrorResponse(statusCode, cgi->resource, cgi->keepAlive);
+    if (cgi->headOnly)
+        trimBody();
+}
+
+/**
+ * @brief Queues body bytes stored after CHUNK_PREFIX bytes of room: gzipped into a chunk, as a
+ * chunk, or as they are up to the Content-Length of the response
+ */
+void Response::addCGIBody(const BufferHandle &body, bool last)
+{
+    CGIBackend &cgi = *_cgi;
+    Segment segment;
+
+    if (!cgi.gzip.isNull())
     {
-        bytesWritten = write(pipeFd, body + totalBytes, WRITE_SIZE(bodySize - totalBytes));
-        if (bytesWritten == -1)
+        BufferHandle compressed(new std::string(CHUNK_PREFIX, ' '));
+        if (!cgi.gzip->compress(body->data() + CHUNK_PREFIX, body->size() - CHUNK_PREFIX, last,
+                                *compressed))
         {
-            time(&curTime);
-            // gateway timed out because cgi must be idle and caused our pipe buffer to fill up
-            if (curTime - startTime > GATEWAY_TIMEOUT)
-            {
-                Log(ERR) << "CGI Error (504): Pipe buf full for too long" << std::endl;
-                close(pipeFd);
-                return 504;
-            }
+            Log(ERR) << "CGI error: could not compress the script's output" << std::endl;
+            cgi.failed = true;
+            return;
         }
-        else if (bytesWritten >= 0)
+        return addChunk(compressed, last);
+    }
+    if (cgi.chunked)
+        return addChunk(body, last);
+    // anything the script writes past its Content-Length is dropped
+    segment.buffer = body;
+    segment.offset = CHUNK_PREFIX;
+    segment.end = CHUNK_PREFIX + std::min(body->size() - CHUNK_PREFIX, cgi.outputLeft);
+    cgi.outputLeft -= segment.end - segment.offset;
+    addSegment(segment);
+}
+
+/**
+ * @brief Starts the response once the script's header block is complete: the status from its
+ * Status or Location header, its other headers and the part of the body read with them. The body
+ * gets a Content-Length when it is known, because the whole output was read with the headers or
+ * the script gave one, and is chunked otherwise, so the connection can always be kept alive.
+ * Locations with compress_types gzip it like static files
+ *
+ * @param complete Whether the script's output ended with what was read so far
+ */
+void Response::startCGIBody(size_t headerEnd, size_t bodyStart, bool complete)
+{
+    CGIBackend &cgi = *_cgi;
+    const Route &route = cgi.resource.config.second;
+    CGIHeaders fields;
+
+    if (!parseCGIHeaders(cgi.header.substr(0, headerEnd), fields))
+    {
+        Log(ERR) << "CGI error 502: invalid header block in the script's output" << std::endl;
+        return failCGI(502);
+    }
+    const bool hasBody = fields.statusCode != 204 && fields.statusCode != 304;
+    BufferHandle body(new std::string(CHUNK_PREFIX, ' '));
+    if (hasBody)
+        body->append(cgi.header, bodyStart, std::string::npos);
+    std::string().swap(cgi.header);
+    if (complete && fields.hasLength && body->size() - CHUNK_PREFIX > fields.contentLength)
+        body->resize(CHUNK_PREFIX + fields.contentLength);
+
+    const bool compressible =
+        hasBody && !fields.encoded && compressesType(route, fields.contentType);
+    const bool lengthKnown = complete || fields.hasLength;
+    size_t length = complete ? body->size() - CHUNK_PREFIX : fields.contentLength;
+    bool compress = compressible && cgi.clientAcceptsGzip &&
+                    (!lengthKnown || length >= route.compressMinLength);
+    if (compress && complete)
+    {
+        BufferHandle compressed(new std::string(CHUNK_PREFIX, ' '));
+        compress = gzipCompress(body->data() + CHUNK_PREFIX, length, route.compressLevel,
+                                *compressed) &&
+                   compressed->size() < body->size();
+        if (compress)
         {
-            time(&startTime);   // reset start timer
-            totalBytes += bytesWritten;
-            Log(DBUG) << "bytesWritten = " << bytesWritten << ", total = " << totalBytes
-                      << std::endl;
+            body = compressed;
+            length = body->size() - CHUNK_PREFIX;
         }
     }
-    close(pipeFd);   // parent done writing to input pipe
-    return 0;
+    else if (compress && !cgi.headOnly)
+        cgi.gzip = SharedPtr<GzipStream>(new GzipStream(route.compressLevel));
+    cgi.chunked = hasBody && !(complete || (fields.hasLength && !compress));
+    cgi.outputLeft = length;
+
+    BufferHandle headers(new std::string(fields.fields));
+    if (compress)
+        headers->append(CONTENT_ENC "gzip" CRLF);
+    if (compressible)
+        headers->append(VARY_ENCODING CRLF);
+    if (hasBody && !cgi.chunked)
+        headers->append(CONTENT_LEN).append(toStr(length)).append(CRLF);
+    if (cgi.keepAlive)
+        headers->append(KEEP_ALIVE CRLF);
+    if (cgi.chunked && !cgi.headOnly)
+        headers->append(CHUNKED CRLF);
+    headers->append(CRLF);
+
+    _statusCode = fields.statusCode;
+    _head.statusLine(fields.status);
+    addHead();
+    addBuffer(headers);
+    if (cgi.headOnly || !hasBody)
+    {
+        _cgi.reset();
+        return;
+    }
+    cgi.streaming = true;
+    if (body->size() != CHUNK_PREFIX || complete)
+        addCGIBody(body, complete);
+    if (complete)
+        _cgi.reset();
 }
 
-void Response::createCGIResponse(Request &req, std::vector<char *> env)
+/**
+ * @brief Reads the script's output until the end of its header block, along with whatever else
+ * is already available, so scripts that are done by then get a Content-Length
+ */
+void Response::readCGIHeaders()
 {
-    int p[2];
-    int status;
-    int errCode;
-    int outFd;
-
-    pid_t pid = startCGIProcess(env, p, outFd);
-    if (pid == -1)
-        return createHTMLResponse(500, errorPage(500, req.resource()), req.keepAlive());
-    if (pid == 0)
-        runCGI(p, outFd, req, env);
-    else
+    CGIBackend &cgi = *_cgi;
+    char buf[CGI_READ_SIZE];
+    ssize_t bytesRead;
+    size_t headerEnd;
+    size_t bodyStart;
+
+    while ((bytesRead = cgi.readOutput(buf, sizeof(buf))) > 0)
     {
-        errCode = sendCGIRequestBody(p[1], req);
-        Log(DBUG) << "WAITING FOR CHILD" << std::endl;
-        pid_t waitStatus = waitCGI(pid, status, errCode);
-        close(p[0]);    // child done reading from input pipe
-        close(outFd);   // child done writing to output pipe
-        std::for_each(env.begin(), env.end(), free);
-        errCode = checkCGIError(pid, errCode, waitStatus, status);
-        if (errCode != EXIT_SUCCESS)
+        cgi.header.append(buf, bytesRead);
+        if (cgi.header.size() > CGI_HEADER_MAX)
+            break;
+    }
+    if (findCGIHeaderEnd(cgi.header, headerEnd, bodyStart) && headerEnd <= CGI_HEADER_MAX)
+        return startCGIBody(headerEnd, bodyStart, bytesRead == 0);
+    if (bytesRead == -1)
+        return;   // nothing more yet
+    Log(ERR) << "CGI error 502: no header block in the script's output" << std::endl;
+    failCGI(502);
+}
+
+/**
+ * @brief Queues the output the script has produced since the last call. On Linux the bytes are
+ * left in the pipe and spliced to the socket, unless they are compressed
+ *
+ * @return int The STREAM_ result
+ */
+int Response::pullCGIOutput()
+{
+    CGIBackend &cgi = *_cgi;
+
+    if (cgi.failed)
+        return STREAM_ERROR;
+    if (!cgi.chunked && cgi.outputLeft == 0)
+    {
+        _cgi.reset();
+        return STREAM_END;
+    }
+#ifdef __linux__
+    size_t available = cgi.gzip.isNull() ? cgi.available() : 0;
+    if (!cgi.chunked)
+        available = std::min(available, cgi.outputLeft);
+    if (available > 0)
+    {
+        Segment segment;
+        if (cgi.chunked)
         {
-            std::remove(CGI_OUTFILE);
-            return createHTMLResponse(errCode, errorPage(errCode, req.resource()), req.keepAlive());
+            BufferHandle sizeLine(new std::string(CHUNK_PREFIX, ' '));
+            sizeLine->erase(0, writeChunkSize(*sizeLine, available));
+            addBuffer(sizeLine);
         }
-        readCGIResponse(req);
+        segment.pipe = cgi.outputPipe();
+        segment.end = available;
+        addSegment(segment);
+        if (cgi.chunked)
+            addBuffer(BufferHandle(new std::string(CRLF)));
+        else
+            cgi.outputLeft -= available;
+        cgi.touch();
+        return STREAM_DATA;
     }
+#endif
+    // at the end of the output, when compressing, or on platforms without splice()
+    BufferHandle body(new std::string(CHUNK_PREFIX + CGI_READ_SIZE, ' '));
+    const ssize_t bytesRead = cgi.readOutput(&(*body)[CHUNK_PREFIX], CGI_READ_SIZE);
+    if (bytesRead == -1)
+        return STREAM_AGAIN;
+    if (bytesRead == 0 && !cgi.chunked)
+    {
+        Log(ERR) << "CGI error: the script's output is shorter than its Content-Length"
+                 << std::endl;
+        cgi.failed = true;
+        return STREAM_ERROR;
+    }
+    body->resize(CHUNK_PREFIX + bytesRead);
+    addCGIBody(body, bytesRead == 0);
+    if (bytesRead != 0)
+        return STREAM_DATA;
+    _cgi.reset();
+    return STREAM_END;
+}
+
+/**
+ * @brief Lets the running CGI script make progress: feeds it more of the request body, and
+ * takes its headers or the next part of its body. A script that keeps the response waiting for
+ * longer than GATEWAY_TIMEOUT is stopped
+ */
+void Response::updateCGI(time_t now)
+{
+    if (_cgi.isNull())
+        return;
+    _cgi->writeInput();
+    if (!_cgi->streaming)
+        readCGIHeaders();
+    else if (!hasOutput())
+        pullCGIOutput();
+    if (_cgi.isNull() || hasOutput() || !_cgi->timedOut(now))
+        return;
+    Log(ERR) << "CGI Error (504): script timed out" << std::endl;
+    if (!_cgi->streaming)
+        return failCGI(504);
+    // the headers are sent, so the connection is closed instead
+    _cgi->terminate();
+    _cgi->failed = true;
+}
+
+/**
+ * @brief Stops the CGI request of a client that is gone, so its script does not run on for an
+ * output nobody reads
+ */
+void Response::cancelCGI()
+{
+    if (_cgi.isNull())
+        return;
+    Log(INFO) << "Client left, cancelling its CGI request" << std::endl;
+    CGIBackend::cancelled++;
+    _cgi->terminate();
+    _cgi.reset();
 }
 
 Response::~Response()
 {
-    if (_buffer != NULL)
-        delete[] _buffer;
 }
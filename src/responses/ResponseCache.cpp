@@ -0,0 +1,175 @@
+/**
+ * @file ResponseCache.cpp
+ * @author agent (agent@local)
+ * @brief Implementation of the serialized response cache
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "responses/ResponseCache.hpp"
+#include "logger/Logger.hpp"
+#include "utils.hpp"
+#include <sys/stat.h>
+
+using logger::Log;
+
+ResponseCache ResponseCache::cache;
+
+ResponseCache::ResponseCache()
+    : _entries(), _ring(), _freeSlots(), _hand(0), _bytes(0), hits(0), misses(0), evictions(0)
+{
+}
+
+ResponseCache &ResponseCache::getCache()
+{
+    return cache;
+}
+
+/**
+ * @brief Builds the cache key of a response. Keep-alive is part of the key because it changes
+ * the serialized headers
+ */
+std::string ResponseCache::key(unsigned int port, const std::string &host, const std::string &path,
+                               bool keepAlive)
+{
+    return toStr(port) + " " + host + " " + (keepAlive ? "k " : "c ") + path;
+}
+
+bool ResponseCache::stillValid(Entry &entry, time_t now)
+{
+    struct stat info;
+
+    if (now - entry.validated < RESPONSE_CACHE_REVALIDATE)
+        return true;
+    if (stat(entry.path.c_str(), &info) == -1 || info.st_mtime != entry.mtime ||
+        info.st_ino != entry.inode || info.st_size != entry.size)
+        return false;
+    entry.validated = now;
+    return true;
+}
+
+void ResponseCache::evict(std::map<std::string, Entry>::iterator entry)
+{
+    // connections still sending this response hold their own reference to the bytes
+    _bytes -= entry->second.response->size();
+    _ring[entry->second.slot].clear();
+    _freeSlots.push_back(entry->second.slot);
+    _entries.erase(entry);
+    evictions++;
+}
+
+/**
+ * @brief Moves the clock hand forward until it finds an entry that has not been used since the
+ * hand last passed it, and evicts it
+ */
+void ResponseCache::evictOne()
+{
+    while (!_entries.empty())
+    {
+        _hand = (_hand + 1) % _ring.size();
+        if (_ring[_hand].empty())
+            continue;
+        std::map<std::string, Entry>::iterator it = _entries.find(_ring[_hand]);
+        if (it->second.referenced)
+        {
+            it->second.referenced = false;
+            continue;
+        }
+        evict(it);
+        return;
+    }
+}
+
+BufferHandle ResponseCache::find(const std::string &key)
+{
+    std::map<std::string, Entry>::iterator it = _entries.find(key);
+
+    if (it == _entries.end())
+    {
+        misses++;
+        return BufferHandle();
+    }
+    if (!stillValid(it->second, time(NULL)))
+    {
+        Log(DBUG) << "Response cache: " << it->second.path << " changed on disk" << std::endl;
+        evict(it);
+        misses++;
+        return BufferHandle();
+    }
+    it->second.referenced = true;
+    hits++;
+    return it->second.response;
+}
+
+void ResponseCache::insert(const std::string &key, const std::string &path, const OpenFile &file,
+                           const BufferHandle &response)
+{
+    if (response->size() > RESPONSE_CACHE_MAX_BYTES)
+        return;
+    std::map<std::string, Entry>::iterator old = _entries.find(key);
+    if (old != _entries.end())
+        evict(old);
+    while (_bytes + response->size() > RESPONSE_CACHE_MAX_BYTES)
+        evictOne();
+
+    Entry &entry = _entries[key];
+    entry.response = response;
+    entry.path = path;
+    entry.mtime = file.mtime;
+    entry.inode = file.inode;
+    entry.size = file.size;
+    entry.validated = time(NULL);
+    entry.referenced = false;
+
+    // reuse a free slot in the ring if there is one
+    if (_freeSlots.empty())
+    {
+        entry.slot = _ring.size();
+        _ring.push_back(key);
+    }
+    else
+    {
+        entry.slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        _ring[entry.slot] = key;
+    }
+    _bytes += response->size();
+}
+
+/**
+ * @brief Drops all responses for a file, used when we modify or delete the file ourselves
+ */
+void ResponseCache::invalidate(const std::string &path)
+{
+    std::map<std::string, Entry>::iterator it = _entries.begin();
+    while (it != _entries.end())
+    {
+        std::map<std::string, Entry>::iterator next = it;
+        next++;
+        if (it->second.path == path)
+            evict(it);
+        it = next;
+    }
+}
+
+/**
+ * @brief Drops every cached response
+ */
+void ResponseCache::purge()
+{
+    Log(INFO) << "Purging " << _entries.size() << " cached responses" << std::endl;
+    _entries.clear();
+    _ring.clear();
+    _freeSlots.clear();
+    _hand = 0;
+    _bytes = 0;
+}
+
+void ResponseCache::logStats() const
+{
+    Log(INFO) << "Response cache: " << _entries.size() << " entries, " << _bytes
+              << " bytes, hits = " << hits << ", misses = " << misses
+              << ", evictions = " << evictions << std::endl;
+}
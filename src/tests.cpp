@@ -9,8 +9,12 @@
  */
 
 #include "tests.hpp"
+#include "cgiUtils.hpp"
 #include "config/Validators.hpp"
 #include "requests/Request.hpp"
+#include "responses/CGICache.hpp"
+#include "responses/HeaderData.hpp"
+#include "responses/HeaderWriter.hpp"
 #include "utils.hpp"
 #include <cassert>
 #include <cstring>
@@ -78,6 +82,74 @@ void inputValidatorTests()
     assert(validateHostName("0/0.0.") == false);
     assert(validateHostName("localhost") == true);
     assert(validateHostName("google.com") == true);
+
+    assert(validatePositiveNumber("") == false);
+    assert(validatePositiveNumber("0") == false);
+    assert(validatePositiveNumber("-5") == false);
+    assert(validatePositiveNumber("+5") == false);
+    assert(validatePositiveNumber("12a") == false);
+    assert(validatePositiveNumber("99999999999") == false);
+    assert(validatePositiveNumber("1") == true);
+    assert(validatePositiveNumber("1000") == true);
+
+    assert(validateDuration("") == false);
+    assert(validateDuration("s") == false);
+    assert(validateDuration("0s") == false);
+    assert(validateDuration("10w") == false);
+    assert(validateDuration("5 m") == false);
+    assert(validateDuration("30") == true);
+    assert(validateDuration("30s") == true);
+    assert(validateDuration("5m") == true);
+    assert(validateDuration("30d") == true);
+
+    assert(validateSize("") == false);
+    assert(validateSize("k") == false);
+    assert(validateSize("0M") == false);
+    assert(validateSize("10t") == false);
+    assert(validateSize("4096") == true);
+    assert(validateSize("512k") == true);
+    assert(validateSize("256M") == true);
+
+    assert(validateMimeType("") == false);
+    assert(validateMimeType("text") == false);
+    assert(validateMimeType("/html") == false);
+    assert(validateMimeType("text/") == false);
+    assert(validateMimeType("text/html/x") == false);
+    assert(validateMimeType("text/html;") == false);
+    assert(validateMimeType("text/html") == true);
+    assert(validateMimeType("image/svg+xml") == true);
+
+    assert(validateUpstream("") == false);
+    assert(validateUpstream("unix:") == false);
+    assert(validateUpstream("localhost") == false);
+    assert(validateUpstream("localhost:") == false);
+    assert(validateUpstream("localhost:0") == false);
+    assert(validateUpstream("unix:/run/php-fpm.sock") == true);
+    assert(validateUpstream("localhost:9000") == true);
+    assert(validateUpstream("127.0.0.1:9000") == true);
+
+    assert(validateExecutable("") == false);
+    assert(validateExecutable("/") == false);
+    assert(validateExecutable("mime_types.txt") == false);
+    assert(validateExecutable("/bin/sh") == true);
+
+    assert(validateCacheKey("") == false);
+    assert(validateCacheKey("$") == false);
+    assert(validateCacheKey("$cookie") == false);
+    assert(validateCacheKey("$http_") == false);
+    assert(validateCacheKey("static") == true);
+    assert(validateCacheKey("$host$request_uri") == true);
+    assert(validateCacheKey("$uri?$args|$http_accept_language") == true);
+
+    assert(durationToSeconds("30") == 30);
+    assert(durationToSeconds("5m") == 300);
+    assert(durationToSeconds("2h") == 7200);
+    assert(durationToSeconds("30d") == 2592000);
+
+    assert(sizeToBytes("4096") == 4096);
+    assert(sizeToBytes("512k") == 524288);
+    assert(sizeToBytes("256M") == 268435456);
+    assert(sizeToBytes("1g") == 1073741824);
 }
 
 void chunkerTests()
@@ -170,3 +242,209 @@ void chunkerTests()
                         "\r\n",
                         req3.buffer(), req3.length()) == 0);
 }
+
+/**
+ * @brief Tests for parsing Range headers and formatting Content-Range values
+ */
+static void rangeTests()
+{
+    std::vector<ByteRange> ranges;
+    char value[CONTENT_RANGE_MAX];
+
+    assert(parseRanges("", 1000, ranges) == RANGE_IGNORED);
+    assert(parseRanges("items=0-9", 1000, ranges) == RANGE_IGNORED);
+    assert(parseRanges("bytes=", 1000, ranges) == RANGE_IGNORED);
+    assert(parseRanges("bytes=-", 1000, ranges) == RANGE_IGNORED);
+    assert(parseRanges("bytes=9-5", 1000, ranges) == RANGE_IGNORED);
+    assert(parseRanges("bytes=a-5", 1000, ranges) == RANGE_IGNORED);
+    assert(parseRanges("bytes=5", 1000, ranges) == RANGE_IGNORED);
+    assert(parseRanges("bytes=0-0,1-1,2-2,3-3,4-4,5-5,6-6,7-7,8-8,9-9,10-10,11-11,12-12,13-13,"
+                       "14-14,15-15,16-16",
+                       1000, ranges) == RANGE_IGNORED);
+
+    ranges.clear();
+    assert(parseRanges("bytes=1000-", 1000, ranges) == RANGE_UNSATISFIABLE);
+    assert(parseRanges("bytes=2000-3000", 1000, ranges) == RANGE_UNSATISFIABLE);
+    assert(ranges.empty());
+
+    assert(parseRanges("bytes=0-499", 1000, ranges) == RANGE_SATISFIABLE);
+    assert(ranges.size() == 1 && ranges[0].start == 0 && ranges[0].end == 500);
+    ranges.clear();
+    assert(parseRanges("bytes=900-", 1000, ranges) == RANGE_SATISFIABLE);
+    assert(ranges.size() == 1 && ranges[0].start == 900 && ranges[0].end == 1000);
+    ranges.clear();
+    assert(parseRanges("bytes=-200", 1000, ranges) == RANGE_SATISFIABLE);
+    assert(ranges.size() == 1 && ranges[0].start == 800 && ranges[0].end == 1000);
+    ranges.clear();
+    assert(parseRanges("bytes=-5000", 1000, ranges) == RANGE_SATISFIABLE);
+    assert(ranges.size() == 1 && ranges[0].start == 0 && ranges[0].end == 1000);
+    ranges.clear();
+    assert(parseRanges("bytes=500-9999", 1000, ranges) == RANGE_SATISFIABLE);
+    assert(ranges.size() == 1 && ranges[0].start == 500 && ranges[0].end == 1000);
+    ranges.clear();
+    assert(parseRanges("bytes= 0-0 , -1, 2000-", 1000, ranges) == RANGE_SATISFIABLE);
+    assert(ranges.size() == 2 && ranges[0].end == 1 && ranges[1].start == 999);
+
+    assert(formatContentRange(&ranges[0], 1000, value) == std::strlen("bytes 0-0/1000"));
+    assert(std::strcmp(value, "bytes 0-0/1000") == 0);
+    formatContentRange(&ranges[1], 1000, value);
+    assert(std::strcmp(value, "bytes 999-999/1000") == 0);
+    formatContentRange(NULL, 1000, value);
+    assert(std::strcmp(value, "bytes */1000") == 0);
+}
+
+/**
+ * @brief Tests for reading the header block of a CGI script's output
+ */
+static void cgiHeaderTests()
+{
+    size_t headerEnd = 0;
+    size_t bodyStart = 0;
+    bool found;
+    CGIHeaders h;
+
+    assert(findCGIHeaderEnd("", headerEnd, bodyStart) == false);
+    assert(findCGIHeaderEnd("Content-Type: text/plain\r\n", headerEnd, bodyStart) == false);
+    // the results are kept outside of assert() so the test still builds with NDEBUG
+    found = findCGIHeaderEnd("A: b\r\n\r\nbody", headerEnd, bodyStart);
+    assert(found && headerEnd == 5 && bodyStart == 8);
+    found = findCGIHeaderEnd("A: b\n\nbody", headerEnd, bodyStart);
+    assert(found && headerEnd == 4 && bodyStart == 6);
+    found = findCGIHeaderEnd("A: b\r\nC: d\n\n", headerEnd, bodyStart);
+    assert(found && headerEnd == 10 && bodyStart == 12);
+    (void)found;
+
+    assert(parseCGIStatus("", h) == false);
+    assert(parseCGIStatus("20", h) == false);
+    assert(parseCGIStatus("abc", h) == false);
+    assert(parseCGIStatus("2000", h) == false);
+    assert(parseCGIStatus("100 Continue", h) == false);
+    assert(parseCGIStatus("600 Nope", h) == false);
+    assert(parseCGIStatus("404", h) == true);
+    assert(h.statusCode == 404 && h.status == "404 Not Found");
+    assert(parseCGIStatus("299", h) == true);
+    assert(h.statusCode == 299 && h.status == "299 ");
+    assert(parseCGIStatus("418 I'm a teapot", h) == true);
+    assert(h.statusCode == 418 && h.status == "418 I'm a teapot");
+
+    h = CGIHeaders();
+    assert(parseCGIHeaders("Content-Type: text/html\r\nStatus: 201 Created\r\n"
+                           "Connection: close\r\nTransfer-Encoding: chunked\r\nX-Id:  7 \r\n",
+                           h) == true);
+    assert(h.statusCode == 201 && h.status == "201 Created");
+    assert(h.contentType == "text/html" && !h.hasLength && !h.encoded);
+    assert(h.fields == "Content-Type: text/html\r\nX-Id: 7\r\n");
+
+    h = CGIHeaders();
+    assert(parseCGIHeaders("Location: /elsewhere\n", h) == true);
+    assert(h.statusCode == 302 && h.status == "302 Found" && h.location == "/elsewhere");
+    h = CGIHeaders();
+    assert(parseCGIHeaders("Location: /elsewhere\nStatus: 307", h) == true);
+    assert(h.statusCode == 307);
+    h = CGIHeaders();
+    assert(parseCGIHeaders("Content-Length: 12\nContent-Encoding: gzip\n", h) == true);
+    assert(h.hasLength && h.contentLength == 12 && h.encoded);
+    assert(h.statusCode == 200 && h.status == "200 OK");
+
+    h = CGIHeaders();
+    assert(parseCGIHeaders("not a header\n", h) == false);
+    h = CGIHeaders();
+    assert(parseCGIHeaders(": empty name\n", h) == false);
+    h = CGIHeaders();
+    assert(parseCGIHeaders("X-A: b\n  folded: line\n", h) == false);
+    h = CGIHeaders();
+    assert(parseCGIHeaders("Status: 200\nStatus: 200\n", h) == false);
+    h = CGIHeaders();
+    assert(parseCGIHeaders("Status: OK\n", h) == false);
+    h = CGIHeaders();
+    assert(parseCGIHeaders("Content-Length: -1\n", h) == false);
+    h = CGIHeaders();
+    assert(parseCGIHeaders("Content-Length: 1\nContent-Length: 1\n", h) == false);
+}
+
+/**
+ * @brief Tests for deciding which CGI responses can be cached
+ */
+static void cgiCacheTests()
+{
+    std::string output = "Content-Type: text/plain\r\n\r\nhello";
+    assert(prepareCGICacheEntry(output) == true);
+    assert(output == "Content-Type: text/plain\r\nContent-Length: 5\r\n\r\nhello");
+
+    output = "Status: 200 OK\nContent-Length: 5\n\nhello";
+    assert(prepareCGICacheEntry(output) == true);
+    assert(output == "Status: 200 OK\nContent-Length: 5\n\nhello");
+
+    output = "Content-Type: text/plain\r\n";
+    assert(prepareCGICacheEntry(output) == false);
+    output = "Set-Cookie: id=1\r\n\r\nhello";
+    assert(prepareCGICacheEntry(output) == false);
+    output = "Status: 404 Not Found\r\n\r\nhello";
+    assert(prepareCGICacheEntry(output) == false);
+    output = "Cache-Control: Private\r\n\r\nhello";
+    assert(prepareCGICacheEntry(output) == false);
+    output = "Cache-Control: max-age=0, no-store\r\n\r\nhello";
+    assert(prepareCGICacheEntry(output) == false);
+    output = "Content-Type: text/plain\r\n\r\n" + std::string(CGI_CACHE_MAX_ENTRY, 'a');
+    assert(prepareCGICacheEntry(output) == false);
+}
+
+/**
+ * @brief Tests for formatting response heads, including heads longer than HEADER_MAX
+ */
+static void headerWriterTests()
+{
+    const std::string preamble = "HTTP/1.1 404 Not Found\r\n"
+                                 "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n";
+    HeaderWriter w;
+
+    HeaderWriter::updateDate(0);
+    w.statusLine(404);
+    w.header("Content-Length: ", static_cast<size_t>(0));
+    w.header("Content-Type: ", "text/html");
+    w.end();
+    assert(std::string(w.data(), w.length()) ==
+           preamble + "Server: " SERVER_SOFTWARE "\r\nContent-Length: 0\r\n"
+                      "Content-Type: text/html\r\n\r\n");
+    assert(w.preambleEnd() == preamble.length());
+
+    w.preamble(200, 60);
+    assert(std::string(w.data(), w.length()) ==
+           "HTTP/1.1 200 OK\r\nDate: Thu, 01 Jan 1970 00:00:00 GMT\r\n"
+           "Expires: Thu, 01 Jan 1970 00:01:00 GMT\r\n");
+    assert(w.preambleEnd() == w.length());
+
+    w.statusLine("299 Custom");
+    assert(std::string(w.data(), std::strlen("HTTP/1.1 299 Custom\r\n")) ==
+           "HTTP/1.1 299 Custom\r\n");
+
+    // a long Location moves the head out of the inline buffer without losing anything
+    const std::string location = "/" + std::string(HEADER_MAX, 'a');
+    w.statusLine(201);
+    w.header("Location: ", location);
+    w.end();
+    const std::string head(w.data(), w.length());
+    const std::string status = "HTTP/1.1 201 Created\r\n";
+    const std::string end = "Location: " + location + "\r\n\r\n";
+    assert(w.length() > HEADER_MAX);
+    assert(head.compare(0, status.length(), status) == 0);
+    assert(head.compare(head.length() - end.length(), end.length(), end) == 0);
+
+    HeaderWriter copy(w);
+    assert(std::string(copy.data(), copy.length()) == head);
+    w.statusLine(204);
+    w.end();
+    assert(std::string(w.data(), w.length()) ==
+           "HTTP/1.1 204 No Content\r\nDate: Thu, 01 Jan 1970 00:00:00 GMT\r\n"
+           "Server: " SERVER_SOFTWARE "\r\n\r\n");
+    copy = w;
+    assert(std::string(copy.data(), copy.length()) == std::string(w.data(), w.length()));
+}
+
+void responseTests()
+{
+    rangeTests();
+    cgiHeaderTests();
+    cgiCacheTests();
+    headerWriterTests();
+}
@@ -11,6 +11,7 @@
 #include "utils.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <fstream>
 #include <iostream>
 #include <sys/stat.h>
@@ -152,15 +153,6 @@ bool isDir(const std::string &path)
     return info.st_mode & S_IFDIR;
 }
 
-std::string headerToEnv(const std::string &header)
-{
-    std::string cgiEnv("HTTP_" + header);
-
-    std::transform(cgiEnv.begin(), cgiEnv.end(), cgiEnv.begin(), ::toupper);
-    std::replace(cgiEnv.begin(), cgiEnv.end(), '-', '_');
-    return cgiEnv;
-}
-
 std::string dirName(const std::string &path)
 {
     if (path.empty())
@@ -173,6 +165,35 @@ std::string dirName(const std::string &path)
     return path.substr(0, lastSlash);
 }
 
+size_t durationToSeconds(const std::string &duration)
+{
+    static const std::string units = "smhd";
+    static const size_t unitSeconds[] = {1, 60, 60 * 60, 24 * 60 * 60};
+
+    if (duration.empty())
+        return 0;
+    const size_t unit = units.find(*duration.rbegin());
+    if (unit == std::string::npos)
+        return fromStr<size_t>(duration);
+    return fromStr<size_t>(duration.substr(0, duration.length() - 1)) * unitSeconds[unit];
+}
+
+size_t sizeToBytes(const std::string &size)
+{
+    static const std::string units = "kmg";
+    size_t bytes;
+
+    if (size.empty())
+        return 0;
+    const size_t unit = units.find(std::tolower(*size.rbegin()));
+    if (unit == std::string::npos)
+        return fromStr<size_t>(size);
+    bytes = fromStr<size_t>(size.substr(0, size.length() - 1));
+    for (size_t i = 0; i <= unit; i++)
+        bytes *= 1024;
+    return bytes;
+}
+
 std::string baseName(const std::string &path)
 {
     if (path.empty())